@@ -1,243 +1,2862 @@
-#include <libakrypt.h>
+#ifndef _GNU_SOURCE
+ #define _GNU_SOURCE
+#endif
+#include "dec.h"
+#ifdef LIBAKRYPT_HAVE_STDIO_H
+ #include <stdio.h>
+#endif
+#ifdef LIBAKRYPT_HAVE_SYSMMAN_H
+ #include <sys/mman.h>
+#endif
+#ifdef LIBAKRYPT_HAVE_SYSSTAT_H
+ #include <sys/stat.h>
+#endif
+#ifdef LIBAKRYPT_HAVE_FCNTL_H
+ #include <fcntl.h>
+#endif
+#ifdef LIBAKRYPT_HAVE_UNISTD_H
+ #include <unistd.h>
+#endif
+#ifdef LIBAKRYPT_HAVE_PTHREAD_H
+ #include <pthread.h>
+ #include <sched.h>
+#endif
+#ifdef LIBAKRYPT_HAVE_TIME_H
+ #include <time.h>
+#endif
 
-int ak_bckey_re_encrypt_dec(ak_bckey bkey, ak_pointer in, ak_pointer out, size_t size, ak_uint64 w, ak_uint64 s, ak_uint64 v,
-                       ak_uint64 l, ak_pointer l_j, ak_pointer l_j_i, ak_uint64 j);
+/* ----------------------------------------------------------------------------------------------- */
+/*! Атомарные операции реализуются встроенными функциями __atomic компиляторов GCC и clang.
+    Если они недоступны, операции выполняются обычными обращениями к памяти: пул потоков
+    обрабатывает разделы в вызывающем потоке, а кэш в разделяемой памяти не поддерживается.      */
+/* ----------------------------------------------------------------------------------------------- */
+#if defined(__GNUC__) || defined(__clang__)
+ #define AK_DEC_ATOMIC
+ #define ak_dec_atomic_load(ptr, order) __atomic_load_n((ptr), __ATOMIC_##order)
+ #define ak_dec_atomic_store(ptr, value, order) __atomic_store_n((ptr), (value), __ATOMIC_##order)
+ #define ak_dec_atomic_fetch_add(ptr, value) __atomic_fetch_add((ptr), (value), __ATOMIC_RELAXED)
+ #define ak_dec_atomic_cas(ptr, expected, desired, order) \
+         __atomic_compare_exchange_n((ptr), (expected), (desired), ak_false, __ATOMIC_##order, __ATOMIC_RELAXED)
+ #define ak_dec_atomic_fence(order) __atomic_thread_fence(__ATOMIC_##order)
+#else
+ #define ak_dec_atomic_load(ptr, order) (*(ptr))
+ #define ak_dec_atomic_store(ptr, value, order) ((void)(*(ptr) = (value)))
+ #define ak_dec_atomic_fetch_add(ptr, value) ((*(ptr) += (value)) - (value))
+ #define ak_dec_atomic_cas(ptr, expected, desired, order) \
+         ((*(ptr) == *(expected)) ? (*(ptr) = (desired), ak_true) : (*(expected) = *(ptr), ak_false))
+ #define ak_dec_atomic_fence(order) ((void)0)
+#endif
+
+#if defined(AK_DEC_ATOMIC) && defined(LIBAKRYPT_HAVE_PTHREAD_H)
+ #define AK_DEC_THREADS
+#endif
+#if defined(AK_DEC_ATOMIC) && defined(LIBAKRYPT_HAVE_SYSMMAN_H) && defined(LIBAKRYPT_HAVE_SYSSTAT_H) && \
+    defined(LIBAKRYPT_HAVE_FCNTL_H) && defined(LIBAKRYPT_HAVE_UNISTD_H)
+ #define AK_DEC_SHARED_MEMORY
+#endif
+#if defined(__linux__) && defined(LIBAKRYPT_HAVE_PTHREAD_H) && defined(CPU_SET)
+ #define AK_DEC_NUMA_AFFINITY
+#endif
+#if defined(__x86_64__) && ((defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 9)) || \
+    (defined(__clang__) && (__clang_major__ >= 10)))
+ #define AK_DEC_KUZNECHIK_GFNI
+ #include <immintrin.h>
+#endif
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Количество соседних секторов, счётчики которых хранятся в одном блоке компактного представления. */
+#define ak_dec_counters_block_size (64)
+/*! Количество блоков, гамма для которых вырабатывается переносимой реализацией алгоритма Кузнечик
+    одновременно (преобразования раундов чередуются между блоками). */
+#define ak_dec_kuznechik_lanes (4)
+/*! Количество блоков, гамма для которых вырабатывается за один проход с инструкциями GFNI. */
+#define ak_dec_kuznechik_gfni_blocks (16)
+/*! Количество попыток захвата записи кэша при её удалении, после которых запись пропускается. */
+#define ak_dec_key_cache_lock_attempts (4096)
+/*! Максимальное количество узлов NUMA, учитываемых при распределении разделов между потоками. */
+#define ak_dec_max_numa_nodes (64)
+/*! Размер большой страницы, до которого округляется размер защищённой области памяти. */
+#define ak_dec_huge_page_size (2097152)
+/*! Наименьшая и наибольшая длины сектора (в байтах), рассматриваемые при подборе параметров режима. */
+#define ak_dec_tune_min_sector (64)
+#define ak_dec_tune_max_sector (4096)
+/*! Наибольшее количество геометрий, измеряемых при подборе параметров режима. */
+#define ak_dec_tune_max_geometries (16)
+/*! Объём данных (в байтах), зашифровываемых при измерении производительности одной геометрии. */
+#define ak_dec_tune_bytes (1048576)
+/*! Наибольшее количество записей отдельных секторов при измерении производительности одной геометрии. */
+#define ak_dec_tune_writes (4096)
+/*! Количество часто изменяемых секторов для профиля \ref dec_write_heavy_profile. */
+#define ak_dec_tune_hot_sectors (4)
+/*! Длина записи (в байтах) для профиля \ref dec_random_small_profile. */
+#define ak_dec_tune_small_write (512)
+/*! Количество производных ключей, вырабатываемых при оценке трудоёмкости их выработки. */
+#define ak_dec_tune_kdf_samples (256)
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Счётчики для алгоритма Магма имеют длину 32 бита, для алгоритма Кузнечик -- 64 бита,
+    то есть длина счётчика в байтах равна половине длины блока.                                   */
+/* ----------------------------------------------------------------------------------------------- */
+static inline ak_uint64 ak_dec_counter_get(size_t bsize, ak_pointer ctr, ak_uint64 idx) {
+    if(bsize == 8) return ((ak_uint32 *)ctr)[idx];
+    return ((ak_uint64 *)ctr)[idx];
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+static inline void ak_dec_counter_set(size_t bsize, ak_pointer ctr, ak_uint64 idx, ak_uint64 value) {
+    if(bsize == 8) ((ak_uint32 *)ctr)[idx] = (ak_uint32)value;
+    else ((ak_uint64 *)ctr)[idx] = value;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+static inline ak_uint64 ak_dec_counter_max(size_t bsize) {
+    if(bsize == 8) return 0xffffffffLL;
+    return 0xffffffffffffffffLL;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*                        компактное представление счётчиков секторов                              */
+/* ----------------------------------------------------------------------------------------------- */
+/*! Блок компактного представления счётчиков: базовое значение (наименьшее из значений счётчиков
+    блока) и приращения счётчиков \ref ak_dec_counters_block_size соседних секторов относительно
+    него. Длина приращения выбирается наименьшей достаточной для разброса значений счётчиков блока:
+    ноль (все счётчики равны базовому значению, приращения не хранятся), один, два или четыре байта,
+    но не более длины счётчика; для алгоритма Кузнечик допускаются также восьмибайтовые приращения,
+    то есть полные значения счётчиков.                                                             */
+/* ----------------------------------------------------------------------------------------------- */
+typedef struct dec_counters_block {
+    /*! Базовое значение счётчиков блока */
+    ak_uint64 base;
+    /*! Приращения счётчиков относительно базового значения (NULL, если длина приращения равна нулю) */
+    ak_pointer delta;
+    /*! Длина приращения в байтах */
+    size_t width;
+} *ak_dec_counters_block;
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция возвращает количество используемых счётчиков в блоке с номером b.                      */
+/* ----------------------------------------------------------------------------------------------- */
+static inline ak_uint64 ak_dec_counters_block_length(ak_dec_counters ctrs, ak_uint64 b) {
+    ak_uint64 first = b * ak_dec_counters_block_size;
+    return (ctrs->count - first < ak_dec_counters_block_size) ? ctrs->count - first : ak_dec_counters_block_size;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+static inline ak_uint64 ak_dec_counters_delta_get(ak_pointer delta, size_t width, ak_uint64 k) {
+    switch(width) {
+        case 1: return ((ak_uint8 *)delta)[k];
+        case 2: return ((ak_uint16 *)delta)[k];
+        case 4: return ((ak_uint32 *)delta)[k];
+        case 8: return ((ak_uint64 *)delta)[k];
+        default: return 0;
+    }
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+static inline void ak_dec_counters_delta_set(ak_pointer delta, size_t width, ak_uint64 k, ak_uint64 value) {
+    switch(width) {
+        case 1: ((ak_uint8 *)delta)[k] = (ak_uint8)value; break;
+        case 2: ((ak_uint16 *)delta)[k] = (ak_uint16)value; break;
+        case 4: ((ak_uint32 *)delta)[k] = (ak_uint32)value; break;
+        case 8: ((ak_uint64 *)delta)[k] = value; break;
+        default: break;
+    }
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция возвращает наименьшую длину приращения (в байтах), достаточную для разброса spread. */
+/* ----------------------------------------------------------------------------------------------- */
+static inline size_t ak_dec_counters_width(ak_uint64 spread) {
+    if(spread == 0) return 0;
+    if(spread <= 0xff) return 1;
+    if(spread <= 0xffff) return 2;
+    if(spread <= 0xffffffffLL) return 4;
+    return 8;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+static inline ak_uint64 ak_dec_counters_value(ak_dec_counters ctrs, ak_uint64 idx) {
+    ak_dec_counters_block blk = ctrs->block + idx / ak_dec_counters_block_size;
+
+    return blk->base + ak_dec_counters_delta_get(blk->delta, blk->width, idx % ak_dec_counters_block_size);
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция присваивает счётчику k блока b значение value и заново выбирает базовое значение
+    блока и длину приращений по фактическому разбросу значений его счётчиков. Память под
+    приращения перераспределяется только при изменении их длины.
+
+    @return В случае возникновения ошибки функция возвращает ее код, в противном случае
+    возвращается \ref ak_error_ok (ноль)                                                           */
+/* ----------------------------------------------------------------------------------------------- */
+static int ak_dec_counters_repack(ak_dec_counters ctrs, ak_uint64 b, ak_uint64 k, ak_uint64 value) {
+    ak_dec_counters_block blk = ctrs->block + b;
+    ak_uint64 n = ak_dec_counters_block_length(ctrs, b), lo = value, hi = value, x = 0;
+    ak_pointer delta = blk->delta;
+    size_t width = 0;
+
+    for(ak_uint64 m = 0; m < n; ++m) {
+        if(m == k) continue;
+        x = blk->base + ak_dec_counters_delta_get(blk->delta, blk->width, m);
+        if(x < lo) lo = x;
+        if(x > hi) hi = x;
+    }
+
+    if((width = ak_dec_counters_width(hi - lo)) != blk->width) {
+        if(width == 0) delta = NULL;
+        else if((delta = malloc(n * width)) == NULL) {
+            return ak_error_message(ak_error_out_of_memory, __func__, "incorrect memory allocation for counters");
+        }
+    }
+    /* при совпадении длин приращения пересчитываются на месте: каждое читается до записи */
+    for(ak_uint64 m = 0; m < n; ++m) {
+        x = (m == k) ? value : blk->base + ak_dec_counters_delta_get(blk->delta, blk->width, m);
+        ak_dec_counters_delta_set(delta, width, m, x - lo);
+    }
+    if(delta != blk->delta) free(blk->delta);
+
+    blk->base = lo;
+    blk->delta = delta;
+    blk->width = width;
+
+    return ak_error_ok;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция сокращает длину приращений блока b до наименьшей, достаточной для текущих значений
+    его счётчиков.                                                                                 */
+/* ----------------------------------------------------------------------------------------------- */
+static void ak_dec_counters_shrink_block(ak_dec_counters ctrs, ak_uint64 b) {
+    ak_dec_counters_block blk = ctrs->block + b;
+
+    if(blk->width != 0) {
+        ak_dec_counters_repack(ctrs, b, 0, blk->base + ak_dec_counters_delta_get(blk->delta, blk->width, 0));
+    }
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция присваивает значение счётчику с номером idx. Если новое значение укладывается
+    в текущую длину приращения, оно записывается на место. В противном случае, а также при
+    увеличении счётчика, имевшего наименьшее в блоке значение (после чего базовое значение
+    может быть сдвинуто), блок перепаковывается функцией ak_dec_counters_repack(): длина
+    приращений увеличивается лишь тогда, когда этого требует фактический разброс значений
+    после сдвига базового значения, и уменьшается, как только разброс это позволяет.
+
+    @return В случае возникновения ошибки функция возвращает ее код, в противном случае
+    возвращается \ref ak_error_ok (ноль)                                                           */
+/* ----------------------------------------------------------------------------------------------- */
+static int ak_dec_counters_assign(ak_dec_counters ctrs, ak_uint64 idx, ak_uint64 value) {
+    ak_uint64 b = idx / ak_dec_counters_block_size, k = idx % ak_dec_counters_block_size;
+    ak_dec_counters_block blk = ctrs->block + b;
+    ak_uint64 old = 0;
+
+    if((value >= blk->base) && (ak_dec_counters_width(value - blk->base) <= blk->width)) {
+        old = ak_dec_counters_delta_get(blk->delta, blk->width, k);
+        ak_dec_counters_delta_set(blk->delta, blk->width, k, value - blk->base);
+        if((old != 0) || (value == blk->base)) return ak_error_ok;
+    }
+
+    return ak_dec_counters_repack(ctrs, b, k, value);
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция создаёт компактное представление счётчиков секторов l_j_i для w разделов по s секторов.
+    Счётчики секторов хранятся блоками по \ref ak_dec_counters_block_size соседних секторов:
+    каждый блок содержит общее базовое значение и приращения длиной 0, 1, 2 или 4 байта
+    (для алгоритма Кузнечик -- также 8 байт), выбираемой по разбросу счётчиков блока. Пока
+    счётчики соседних секторов близки, на один сектор приходится не более одного-двух байт вместо
+    четырёх (Магма) или восьми (Кузнечик) байт плоского массива; в худшем случае объём превышает
+    плоский массив лишь на заголовки блоков (24 байта на \ref ak_dec_counters_block_size секторов).
+
+    Начальные значения всех счётчиков равны нулю.
+
+    @param ctrs Контекст счётчиков.
+    @param bsize Длина блока алгоритма блочного шифрования, определяющая разрядность счётчиков.
+    @param w Количество разделов.
+    @param s Количество секторов в разделе.
+
+    @return В случае возникновения ошибки функция возвращает ее код, в противном случае
+    возвращается \ref ak_error_ok (ноль)                                                           */
+/* ----------------------------------------------------------------------------------------------- */
+int ak_dec_counters_create(ak_dec_counters ctrs, size_t bsize, ak_uint64 w, ak_uint64 s) {
+    if(ctrs == NULL) {
+        return ak_error_message(ak_error_null_pointer, __func__, "using null pointer to counters context");
+    }
+    if((bsize != 8) && (bsize != 16)) {
+        return ak_error_message(ak_error_wrong_block_cipher, __func__ , "incorrect block size of block cipher key");
+    }
+    if((w == 0) || (s == 0)) {
+        return ak_error_message(ak_error_zero_length, __func__, "using zero number of volumes or sectors");
+    }
+
+    ctrs->bsize = bsize;
+    ctrs->w = w;
+    ctrs->s = s;
+    ctrs->count = w * s;
+    ctrs->blocks = (ctrs->count + ak_dec_counters_block_size - 1) / ak_dec_counters_block_size;
+    if((ctrs->block = calloc(ctrs->blocks, sizeof(struct dec_counters_block))) == NULL) {
+        return ak_error_message(ak_error_out_of_memory, __func__, "incorrect memory allocation for counters");
+    }
+
+    return ak_error_ok;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! @param ctrs Контекст счётчиков.
+    @return В случае возникновения ошибки функция возвращает ее код, в противном случае
+    возвращается \ref ak_error_ok (ноль)                                                           */
+/* ----------------------------------------------------------------------------------------------- */
+int ak_dec_counters_destroy(ak_dec_counters ctrs) {
+    if(ctrs == NULL) {
+        return ak_error_message(ak_error_null_pointer, __func__, "using null pointer to counters context");
+    }
+    if(ctrs->block != NULL) {
+        for(ak_uint64 b = 0; b < ctrs->blocks; ++b) free(ctrs->block[b].delta);
+        free(ctrs->block);
+    }
+    memset(ctrs, 0, sizeof(struct dec_counters));
+
+    return ak_error_ok;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция загружает значения счётчиков из плоского массива l_j_i, имеющего формат,
+    принимаемый функцией \ref ak_bckey_encrypt_dec().
+
+    @param ctrs Контекст счётчиков.
+    @param l_j_i Указатель на массив из w*s счётчиков секторов.
+    @return В случае возникновения ошибки функция возвращает ее код, в противном случае
+    возвращается \ref ak_error_ok (ноль)                                                           */
+/* ----------------------------------------------------------------------------------------------- */
+int ak_dec_counters_import(ak_dec_counters ctrs, ak_pointer l_j_i) {
+    int error = ak_error_ok;
+
+    if((ctrs == NULL) || (l_j_i == NULL)) {
+        return ak_error_message(ak_error_null_pointer, __func__, "using null pointer to counters");
+    }
+    for(ak_uint64 idx = 0; idx < ctrs->count; ++idx) {
+        if((error = ak_dec_counters_assign(ctrs, idx, ak_dec_counter_get(ctrs->bsize, l_j_i, idx))) != ak_error_ok) {
+            return error;
+        }
+    }
+    for(ak_uint64 b = 0; b < ctrs->blocks; ++b) ak_dec_counters_shrink_block(ctrs, b);
+
+    return error;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция выгружает значения счётчиков в плоский массив l_j_i, имеющий формат,
+    принимаемый функцией \ref ak_bckey_encrypt_dec().
+
+    @param ctrs Контекст счётчиков.
+    @param l_j_i Указатель на массив из w*s счётчиков секторов.
+    @return В случае возникновения ошибки функция возвращает ее код, в противном случае
+    возвращается \ref ak_error_ok (ноль)                                                           */
+/* ----------------------------------------------------------------------------------------------- */
+int ak_dec_counters_export(ak_dec_counters ctrs, ak_pointer l_j_i) {
+    if((ctrs == NULL) || (l_j_i == NULL)) {
+        return ak_error_message(ak_error_null_pointer, __func__, "using null pointer to counters");
+    }
+    for(ak_uint64 idx = 0; idx < ctrs->count; ++idx) {
+        ak_dec_counter_set(ctrs->bsize, l_j_i, idx, ak_dec_counters_value(ctrs, idx));
+    }
+
+    return ak_error_ok;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! @param ctrs Контекст счётчиков.
+    @return Функция возвращает объём памяти (в байтах), занимаемой счётчиками.                    */
+/* ----------------------------------------------------------------------------------------------- */
+size_t ak_dec_counters_get_memory_size(ak_dec_counters ctrs) {
+    size_t size = 0;
+
+    if((ctrs == NULL) || (ctrs->block == NULL)) return 0;
+    size = ctrs->blocks * sizeof(struct dec_counters_block);
+    for(ak_uint64 b = 0; b < ctrs->blocks; ++b) {
+        size += ak_dec_counters_block_length(ctrs, b) * ctrs->block[b].width;
+    }
+
+    return size;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Счётчики секторов, с которыми работает общий проход по разделам: либо плоский массив,
+    переданный пользователем, либо компактное представление \ref dec_counters.                  */
+/* ----------------------------------------------------------------------------------------------- */
+typedef struct dec_counter_view {
+    /*! Длина блока алгоритма блочного шифрования */
+    size_t bsize;
+    /*! Плоский массив счётчиков (используется, если compact равен NULL) */
+    ak_pointer flat;
+    /*! Компактное представление счётчиков */
+    ak_dec_counters compact;
+} *ak_dec_counter_view;
+
+/* ----------------------------------------------------------------------------------------------- */
+static inline ak_uint64 ak_dec_view_get(ak_dec_counter_view view, ak_uint64 idx) {
+    if(view->compact != NULL) return ak_dec_counters_value(view->compact, idx);
+    return ak_dec_counter_get(view->bsize, view->flat, idx);
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+static inline int ak_dec_view_set(ak_dec_counter_view view, ak_uint64 idx, ak_uint64 value) {
+    if(view->compact != NULL) return ak_dec_counters_assign(view->compact, idx, value);
+    ak_dec_counter_set(view->bsize, view->flat, idx, value);
+    return ak_error_ok;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+static inline bool_t ak_dec_dirty_bit(const ak_uint8 *dirty, ak_uint64 idx) {
+    return (dirty[idx >> 3] >> (idx & 7)) & 1;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция проверяет параметры режима `DEC`, общие для функций зашифрования и расшифрования.
+
+    @return В случае возникновения ошибки функция возвращает ее код, в противном случае
+    возвращается \ref ak_error_ok (ноль)                                                           */
+/* ----------------------------------------------------------------------------------------------- */
+static int ak_dec_check_parameters(ak_bckey bkey, ak_pointer in, ak_pointer out, size_t size, ak_uint64 w,
+                                   ak_uint64 s, ak_uint64 v, ak_uint64 l, ak_pointer l_j, ak_pointer l_j_i) {
+    ak_uint64 q = 0;
+
+    if(bkey == NULL) {
+        return ak_error_message(ak_error_null_pointer, __func__, "using null pointer to block cipher key");
+    }
+
+    if((bkey->bsize != 8) &&  (bkey->bsize != 16)) {
+        return ak_error_message(ak_error_wrong_block_cipher, __func__ , "incorrect block size of block cipher key");
+    }
+
+    if(l_j == NULL) {
+        return ak_error_message(ak_error_null_pointer, __func__, "incorrect pointer to l_j");
+    }
+
+    if(l_j_i == NULL) {
+        return ak_error_message(ak_error_null_pointer, __func__, "incorrect pointer to l_j_i");
+    }
+
+    if(in == NULL) {
+        return ak_error_message(ak_error_null_pointer, __func__, "incorrect pointer to plain text");
+    }
+
+    if(out == NULL) {
+        return ak_error_message(ak_error_null_pointer, __func__, "incorrect pointer to cipher text");
+    }
+
+    if((w == 0) || (s == 0) || (v == 0) || (l == 0)) {
+        return ak_error_message(ak_error_zero_length, __func__, "using zero value of dec parameter");
+    }
+
+    if(l % bkey->bsize != 0) {
+        return ak_error_message(ak_error_wrong_length, __func__, "incorrect sector byte size");
+    }
+    q = l / bkey->bsize;
+
+    if((ak_uint64)(2 << (bkey->bsize / 2)) % q != 0) {
+        return ak_error_message(ak_error_wrong_length, __func__, "incorrect number of blocks in a sector");
+    }
+
+    if((ak_uint64)(2 << (bkey->bsize / 2)) % w != 0) {
+        return ak_error_message(ak_error_wrong_length, __func__, "incorrect number of volumes");
+    }
+
+    if((ak_uint64)(2 << (bkey->bsize / 2)) % s != 0) {
+        return ak_error_message(ak_error_wrong_length, __func__, "incorrect number of sectors in a volume");
+    }
+
+    if(((ak_uint64)2 << (bkey->bsize / 2)) < v * q) {
+        return ak_error_message(ak_error_wrong_length, __func__, "incorrect frequency of changing key_in");
+    }
+
+    if(size < w * s * l) {
+        return ak_error_message(ak_error_wrong_length, __func__, "data length is less than w*s*l bytes");
+    }
+
+    return ak_error_ok;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+static void ak_dec_wipe(ak_pointer ptr, size_t size) {
+    volatile ak_uint8 *p = (volatile ak_uint8 *)ptr;
+    while(size--) *p++ = 0;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*                   защищённая область памяти для ключей и временных буферов                      */
+/* ----------------------------------------------------------------------------------------------- */
+/*! Рабочая область одной операции режима `DEC`: производные ключи, состояние функции
+    выработки ключей, контекст ключа сектора (алгоритм Магма), развёрнутый ключ сектора
+    (алгоритм Кузнечик) и буферы значений счётчика и гаммы.
+    Контекст ключа сектора создаётся при обработке первого сектора и используется для всех
+    секторов, обрабатываемых с этой рабочей областью: для очередного сектора прежние раундовые
+    ключи уничтожаются и ему присваивается новое значение ключа. Контекст уничтожается
+    при возврате рабочей области.                                                                  */
+/* ----------------------------------------------------------------------------------------------- */
+typedef struct dec_workspace {
+    /*! Ключ раздела */
+    ak_uint8 k_j[32];
+    /*! Контекст ключа, номер раздела и значение его счётчика, для которых выработан ключ k_j
+        функцией ak_dec_workspace_volume_key(); NULL -- ключ не сохранён */
+    ak_bckey k_j_bkey;
+    ak_uint64 k_j_number, k_j_counter;
+    /*! Ключ сектора */
+    ak_uint8 k_j_i[32];
+    /*! Новый ключ раздела (при перешифровании) */
+    ak_uint8 k_j_sh[32];
+    /*! Новый ключ сектора (при перешифровании) */
+    ak_uint8 k_j_i_sh[32];
+    /*! Состояние функции выработки производных ключей */
+    struct kdf_state ks;
+    /*! Контекст ключа сектора */
+    struct bckey context;
+    /*! Длина блока алгоритма, для которого создан контекст ключа сектора; ноль -- не создан */
+    size_t context_bsize;
+    /*! Развёрнутый ключ сектора для алгоритма Кузнечик (раундовые ключи K_1, ..., K_10) */
+    ak_uint128 round_keys[10];
+    /*! Значение счётчика */
+    ak_uint64 ctr[2];
+    /*! Гамма */
+    ak_uint64 gamma[2];
+} *ak_dec_workspace;
+
+/*! Наименьший размер защищённой области: две рабочие области (обработка раздела и вложенное
+    перешифрование раздела при исчерпании счётчика сектора) с учётом выравнивания. */
+#define ak_dec_arena_min_size (2 * ((sizeof(struct dec_workspace) + 63) & ~((size_t)63)))
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция выделяет в области arena фрагмент памяти размера size, выровненный на 64 байта.
+
+    @return Функция возвращает указатель на фрагмент либо NULL, если память области исчерпана.  */
+/* ----------------------------------------------------------------------------------------------- */
+static ak_pointer ak_dec_arena_alloc(ak_dec_arena arena, size_t size) {
+    size_t offset = (arena->used + 63) & ~((size_t)63);
+
+    if((arena->base == NULL) || (offset > arena->size) || (size > arena->size - offset)) return NULL;
+    arena->used = offset + size;
+    return arena->base + offset;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция затирает память, выделенную в области arena после отметки mark, и возвращает её
+    в область.                                                                                     */
+/* ----------------------------------------------------------------------------------------------- */
+static void ak_dec_arena_release(ak_dec_arena arena, size_t mark) {
+    if(arena->used > mark) ak_dec_wipe(arena->base + mark, arena->used - mark);
+    arena->used = mark;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция создаёт защищённую область памяти для ключевой информации и временных буферов режима
+    `DEC`. Область размещается, по возможности, в больших страницах (MAP_HUGETLB; если они
+    недоступны -- в обычных страницах с рекомендацией ядру использовать прозрачные большие
+    страницы), блокируется в оперативной памяти и исключается из дампов памяти процесса.
+    Память выделяется последовательно и затирается при возврате.
+
+    @param arena Контекст области.
+    @param size Размер области в байтах; при использовании больших страниц округляется вверх
+    до размера большой страницы.
+
+    @return В случае возникновения ошибки функция возвращает ее код, в противном случае
+    возвращается \ref ak_error_ok (ноль)                                                           */
+/* ----------------------------------------------------------------------------------------------- */
+int ak_dec_arena_create(ak_dec_arena arena, size_t size) {
+    ak_pointer ptr = NULL;
+
+    if(arena == NULL) {
+        return ak_error_message(ak_error_null_pointer, __func__, "using null pointer to secure arena");
+    }
+    if(size == 0) {
+        return ak_error_message(ak_error_zero_length, __func__, "using zero size of secure arena");
+    }
+    memset(arena, 0, sizeof(struct dec_arena));
+
+#ifdef LIBAKRYPT_HAVE_SYSMMAN_H
+ #ifdef MAP_HUGETLB
+    arena->size = (size + ak_dec_huge_page_size - 1) & ~((size_t)ak_dec_huge_page_size - 1);
+    if((ptr = mmap(NULL, arena->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                   -1, 0)) != MAP_FAILED) {
+        arena->huge = ak_true;
+    }
+ #endif
+    if(!arena->huge) {
+        arena->size = size;
+        if((ptr = mmap(NULL, arena->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                       -1, 0)) == MAP_FAILED) {
+            memset(arena, 0, sizeof(struct dec_arena));
+            return ak_error_message(ak_error_out_of_memory, __func__, "wrong mapping of secure arena");
+        }
+  #ifdef MADV_HUGEPAGE
+        madvise(ptr, arena->size, MADV_HUGEPAGE);
+  #endif
+    }
+ #ifdef MADV_DONTDUMP
+    madvise(ptr, arena->size, MADV_DONTDUMP);
+ #endif
+    if(mlock(ptr, arena->size) != 0) {
+        munmap(ptr, arena->size);
+        memset(arena, 0, sizeof(struct dec_arena));
+        return ak_error_message(ak_error_out_of_memory, __func__, "wrong locking of secure arena");
+    }
+#else
+    if((ptr = malloc(size)) == NULL) {
+        return ak_error_message(ak_error_out_of_memory, __func__, "incorrect memory allocation for secure arena");
+    }
+    arena->size = size;
+#endif
+    arena->base = (ak_uint8 *)ptr;
+
+    return ak_error_ok;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция затирает всю область и освобождает занимаемую ею память.
+
+    @param arena Контекст области.
+    @return В случае возникновения ошибки функция возвращает ее код, в противном случае
+    возвращается \ref ak_error_ok (ноль)                                                           */
+/* ----------------------------------------------------------------------------------------------- */
+int ak_dec_arena_destroy(ak_dec_arena arena) {
+    if(arena == NULL) {
+        return ak_error_message(ak_error_null_pointer, __func__, "using null pointer to secure arena");
+    }
+    if(arena->base != NULL) {
+        ak_dec_wipe(arena->base, arena->size);
+#ifdef LIBAKRYPT_HAVE_SYSMMAN_H
+        munlock(arena->base, arena->size);
+        munmap(arena->base, arena->size);
+#else
+        free(arena->base);
+#endif
+    }
+    memset(arena, 0, sizeof(struct dec_arena));
+
+    return ak_error_ok;
+}
+
+/*! Размер защищённой области, создаваемой для каждого потока; ноль -- области не используются */
+static size_t ak_dec_thread_arena_size = 0;
+
+#ifdef LIBAKRYPT_HAVE_PTHREAD_H
+/* ----------------------------------------------------------------------------------------------- */
+/*! Защищённая область, закреплённая за потоком либо ожидающая повторного использования
+    в списке свободных областей процесса.                                                          */
+/* ----------------------------------------------------------------------------------------------- */
+ typedef struct dec_arena_slot {
+    /*! Область */
+    struct dec_arena arena;
+    /*! Размер, запрошенный при создании области */
+    size_t size;
+    /*! Следующая свободная область */
+    struct dec_arena_slot *next;
+ } *ak_dec_arena_slot;
+
+ static pthread_key_t ak_dec_thread_arena_key;
+ static pthread_once_t ak_dec_thread_arena_once = PTHREAD_ONCE_INIT;
+ static pthread_mutex_t ak_dec_arena_stock_mutex = PTHREAD_MUTEX_INITIALIZER;
+ /*! Свободные области, возвращённые завершившимися потоками */
+ static ak_dec_arena_slot ak_dec_arena_stock = NULL;
+
+/* ----------------------------------------------------------------------------------------------- */
+ static void ak_dec_arena_slot_free(ak_dec_arena_slot slot) {
+    while(slot != NULL) {
+        ak_dec_arena_slot next = slot->next;
+
+        ak_dec_arena_destroy(&slot->arena);
+        free(slot);
+        slot = next;
+    }
+ }
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция вызывается при завершении потока: область затирается и, если её размер соответствует
+    текущим настройкам, помещается в список свободных областей для следующих потоков.              */
+/* ----------------------------------------------------------------------------------------------- */
+ static void ak_dec_thread_arena_return(void *ptr) {
+    ak_dec_arena_slot slot = (ak_dec_arena_slot)ptr;
+
+    ak_dec_arena_release(&slot->arena, 0);
+    pthread_mutex_lock(&ak_dec_arena_stock_mutex);
+    if(slot->size == ak_dec_atomic_load(&ak_dec_thread_arena_size, RELAXED)) {
+        slot->next = ak_dec_arena_stock;
+        ak_dec_arena_stock = slot;
+        slot = NULL;
+    }
+    pthread_mutex_unlock(&ak_dec_arena_stock_mutex);
+    ak_dec_arena_slot_free(slot);
+ }
+
+/* ----------------------------------------------------------------------------------------------- */
+ static void ak_dec_thread_arena_init(void) {
+    pthread_key_create(&ak_dec_thread_arena_key, ak_dec_thread_arena_return);
+ }
+#else
+ static struct dec_arena ak_dec_process_arena;
+ /*! Размер, запрошенный при создании области процесса */
+ static size_t ak_dec_process_arena_size = 0;
+#endif
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция возвращает защищённую область текущего потока. При первом обращении поток берёт
+    область из списка свободных областей, оставленных завершившимися потоками, а если список
+    пуст -- создаёт новую; поэтому потоки, создаваемые при каждом многопоточном вызове, не
+    выделяют и не блокируют память заново. Страницы новой области размещаются в памяти узла NUMA,
+    на котором выполняется создавший её поток.
+
+    Если области отключены или создать область не удалось, функция возвращает NULL; в последнем
+    случае попытка повторяется при следующем обращении.                                           */
+/* ----------------------------------------------------------------------------------------------- */
+static ak_dec_arena ak_dec_thread_arena(void) {
+    size_t size = ak_dec_atomic_load(&ak_dec_thread_arena_size, RELAXED);
+#ifdef LIBAKRYPT_HAVE_PTHREAD_H
+    ak_dec_arena_slot slot = NULL;
+
+    if(size == 0) return NULL;
+    pthread_once(&ak_dec_thread_arena_once, ak_dec_thread_arena_init);
+    if((slot = pthread_getspecific(ak_dec_thread_arena_key)) != NULL) {
+        if(slot->size == size) return &slot->arena;
+        pthread_setspecific(ak_dec_thread_arena_key, NULL);
+        ak_dec_arena_slot_free(slot);
+    }
+
+    pthread_mutex_lock(&ak_dec_arena_stock_mutex);
+    if((slot = ak_dec_arena_stock) != NULL) {
+        ak_dec_arena_stock = slot->next;
+        slot->next = NULL;
+    }
+    pthread_mutex_unlock(&ak_dec_arena_stock_mutex);
+
+    if(slot == NULL) {
+        if((slot = calloc(1, sizeof(struct dec_arena_slot))) == NULL) return NULL;
+        if(ak_dec_arena_create(&slot->arena, size) != ak_error_ok) {
+            free(slot);
+            return NULL;
+        }
+        slot->size = size;
+    }
+    pthread_setspecific(ak_dec_thread_arena_key, slot);
+    return &slot->arena;
+#else
+    if(size == 0) return NULL;
+    if((ak_dec_process_arena.base != NULL) && (ak_dec_process_arena_size != size)) {
+        ak_dec_arena_destroy(&ak_dec_process_arena);
+    }
+    if(ak_dec_process_arena.base == NULL) {
+        if(ak_dec_arena_create(&ak_dec_process_arena, size) != ak_error_ok) return NULL;
+        ak_dec_process_arena_size = size;
+    }
+    return &ak_dec_process_arena;
+#endif
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция включает (size > 0) или отключает (size = 0) использование защищённых областей
+    памяти функциями режима `DEC`. При включении каждый поток, выполняющий шифрование, получает
+    собственную область размера size (см. \ref ak_dec_arena_create()) и размещает в ней
+    производные ключи, контексты ключей секторов, состояние функции выработки ключей и буферы
+    гаммы. При завершении потока область затирается и сохраняется для повторного использования
+    другими потоками, так что многопоточные вызовы не создают области заново. Без защищённых
+    областей эти данные размещаются в стеке и затираются по завершении обработки раздела.
+
+    Область вызывающего потока создаётся немедленно; если создать или заблокировать её в памяти
+    не удалось, защищённые области остаются отключёнными и функция возвращает код ошибки.
+    Если при включённых областях создать область не удаётся потоку, выполняющему шифрование,
+    функция шифрования завершается с ошибкой \ref ak_error_out_of_memory, а не размещает
+    ключевую информацию в стеке.
+
+    При отключении, а также при изменении размера, область вызывающего потока и сохранённые
+    свободные области затираются и освобождаются немедленно; области других потоков --
+    при их завершении. Функцию не следует вызывать одновременно с функциями шифрования
+    в других потоках.
+
+    @param size Размер области каждого потока в байтах (рекомендуется размер большой страницы);
+    не менее \ref ak_dec_arena_min_size.
+    @return В случае возникновения ошибки функция возвращает ее код, в противном случае
+    возвращается \ref ak_error_ok (ноль)                                                           */
+/* ----------------------------------------------------------------------------------------------- */
+int ak_dec_set_secure_arena(size_t size) {
+#ifdef LIBAKRYPT_HAVE_PTHREAD_H
+    ak_dec_arena_slot slot = NULL;
+#endif
+
+    if((size != 0) && (size < ak_dec_arena_min_size)) {
+        return ak_error_message(ak_error_wrong_length, __func__, "secure arena is too small for dec workspaces");
+    }
+    ak_dec_atomic_store(&ak_dec_thread_arena_size, size, RELAXED);
+
+#ifdef LIBAKRYPT_HAVE_PTHREAD_H
+    pthread_once(&ak_dec_thread_arena_once, ak_dec_thread_arena_init);
+    pthread_mutex_lock(&ak_dec_arena_stock_mutex);
+    slot = ak_dec_arena_stock;
+    ak_dec_arena_stock = NULL;
+    pthread_mutex_unlock(&ak_dec_arena_stock_mutex);
+    ak_dec_arena_slot_free(slot);
+
+    if(((slot = pthread_getspecific(ak_dec_thread_arena_key)) != NULL) && (slot->size != size)) {
+        pthread_setspecific(ak_dec_thread_arena_key, NULL);
+        ak_dec_arena_slot_free(slot);
+    }
+#else
+    if((ak_dec_process_arena.base != NULL) && (ak_dec_process_arena_size != size)) {
+        ak_dec_arena_destroy(&ak_dec_process_arena);
+    }
+#endif
+    if((size != 0) && (ak_dec_thread_arena() == NULL)) {
+        ak_dec_atomic_store(&ak_dec_thread_arena_size, 0, RELAXED);
+        return ak_error_message(ak_error_out_of_memory, __func__, "secure arena cannot be created or locked");
+    }
+
+    return ak_error_ok;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция выделяет рабочую область в защищённой области потока, либо, если защищённые области
+    отключены, возвращает область local, размещённую вызывающей функцией в стеке.
+
+    @return Функция возвращает указатель на рабочую область либо NULL, если защищённые области
+    включены, но область потока недоступна.                                                       */
+/* ----------------------------------------------------------------------------------------------- */
+static ak_dec_workspace ak_dec_workspace_acquire(ak_dec_workspace local, ak_dec_arena *arena, size_t *mark) {
+    ak_dec_workspace ws = NULL;
+
+    if((*arena = ak_dec_thread_arena()) != NULL) {
+        *mark = (*arena)->used;
+        if((ws = ak_dec_arena_alloc(*arena, sizeof(struct dec_workspace))) != NULL) {
+            ws->context_bsize = 0;
+            ws->k_j_bkey = NULL;
+            return ws;
+        }
+        *arena = NULL;
+    } else if(ak_dec_atomic_load(&ak_dec_thread_arena_size, RELAXED) != 0) {
+        ak_error_message(ak_error_out_of_memory, __func__, "secure arena is not available in this thread");
+        return NULL;
+    }
+    local->context_bsize = 0;
+    local->k_j_bkey = NULL;
+    return local;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция уничтожает контекст ключа сектора, затирает рабочую область и возвращает её
+    в защищённую область потока.                                                                   */
+/* ----------------------------------------------------------------------------------------------- */
+static void ak_dec_workspace_release(ak_dec_workspace ws, ak_dec_arena arena, size_t mark) {
+    if(ws->context_bsize != 0) ak_bckey_destroy(&ws->context);
+    if(arena != NULL) ak_dec_arena_release(arena, mark);
+    else ak_dec_wipe(ws, sizeof(struct dec_workspace));
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция вырабатывает ключ раздела k_j из ключа bkey, номера раздела j и значения его счётчика.
+
+    @return В случае возникновения ошибки функция возвращает ее код, в противном случае
+    возвращается \ref ak_error_ok (ноль)                                                           */
+/* ----------------------------------------------------------------------------------------------- */
+static int ak_dec_derive_volume_key(ak_dec_workspace ws, ak_bckey bkey, ak_uint64 j, ak_uint64 l_j,
+                                    ak_uint8 *k_j) {
+    int error = ak_error_ok;
+    ak_uint8 seed[32] = {0};
+    ak_uint128 z0 = {{0}};
+    ak_uint128 P;
+
+    if(bkey->bsize == 8) {
+        P.q[0] = l_j;
+        P.q[0] <<= sizeof(P.q[0]) * 8 / 2;
+        P.q[0] = P.q[0] + j;
+
+        error = ak_kdf_state_create(&ws->ks, bkey->key.key, bkey->key.key_size, xor_cmac_magma_kdf,
+                                    (ak_uint8 *)&P.q[0], sizeof(P.q[0]), seed, sizeof(seed),
+                                    (ak_uint8 *)&z0.q[0], sizeof(z0.q[0]), 32768);
+    } else {
+        P.q[1] = l_j;
+        P.q[0] = j;
+
+        error = ak_kdf_state_create(&ws->ks, bkey->key.key, bkey->key.key_size, xor_cmac_kuznechik_kdf,
+                                    (ak_uint8 *)&P, sizeof(ak_uint128), seed, sizeof(seed),
+                                    (ak_uint8 *)&z0, sizeof(ak_uint128), 32768);
+    }
+    if(error != ak_error_ok) {
+        return ak_error_message(error, __func__, "incorrect creation of kdf state");
+    }
+
+    error = ak_kdf_state_next(&ws->ks, k_j, 32);
+    ak_kdf_state_destroy(&ws->ks);
+
+    return error;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция вырабатывает ключ сектора k_j_i из ключа раздела k_j, номеров раздела j и сектора i,
+    а также номера эпохи сектора, равного частному от деления счётчика сектора на частоту смены ключа.
+
+    @return В случае возникновения ошибки функция возвращает ее код, в противном случае
+    возвращается \ref ak_error_ok (ноль)                                                           */
+/* ----------------------------------------------------------------------------------------------- */
+static int ak_dec_derive_sector_key(ak_dec_workspace ws, size_t bsize, ak_uint8 *k_j, ak_uint64 j, ak_uint64 i,
+                                    ak_uint64 epoch, ak_uint8 *k_j_i) {
+    int error = ak_error_ok;
+    ak_uint8 seed[32] = {0};
+    ak_uint128 z0 = {{0}};
+    ak_uint128 P;
+
+    if(bsize == 8) {
+        z0.q[0] = j;
+        z0.q[0] <<= sizeof(z0.q[0]) * 8 / 2;
+
+        P.q[0] = epoch;
+        P.q[0] <<= sizeof(P.q[0]) * 8 / 2;
+        P.q[0] = P.q[0] + i;
+
+        error = ak_kdf_state_create(&ws->ks, k_j, 32, xor_cmac_magma_kdf, (ak_uint8 *)&P.q[0], sizeof(P.q[0]),
+                                    seed, sizeof(seed), (ak_uint8 *)&z0.q[0], sizeof(z0.q[0]), 32768);
+    } else {
+        z0.q[1] = j;
+
+        P.q[1] = epoch;
+        P.q[0] = i;
+
+        error = ak_kdf_state_create(&ws->ks, k_j, 32, xor_cmac_kuznechik_kdf, (ak_uint8 *)&P, sizeof(ak_uint128),
+                                    seed, sizeof(seed), (ak_uint8 *)&z0, sizeof(ak_uint128), 32768);
+    }
+    if(error != ak_error_ok) {
+        return ak_error_message(error, __func__, "incorrect creation of kdf state");
+    }
+
+    error = ak_kdf_state_next(&ws->ks, k_j_i, 32);
+    ak_kdf_state_destroy(&ws->ks);
+
+    return error;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*                     разделяемый между процессами кэш производных ключей                         */
+/* ----------------------------------------------------------------------------------------------- */
+/*! Значение поля `magic` заголовка инициализированного сегмента ("DECKEYS\0") */
+#define ak_dec_key_cache_magic (0x005359454b434544LL)
+/*! Номер сектора, под которым в кэше хранятся ключи разделов */
+#define ak_dec_key_cache_volume (0xffffffffffffffffLL)
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Запись кэша. Поле `seq` реализует блокировку последовательности (seqlock): нечётное значение
+    означает, что запись изменяется; читатель копирует запись и повторно сверяет значение `seq`. */
+/* ----------------------------------------------------------------------------------------------- */
+typedef struct dec_key_cache_entry {
+    /*! Счётчик версий записи */
+    ak_uint64 seq;
+    /*! Признак того, что запись содержит ключ */
+    ak_uint64 used;
+    /*! Номер раздела */
+    ak_uint64 j;
+    /*! Номер сектора, либо \ref ak_dec_key_cache_volume для ключа раздела */
+    ak_uint64 i;
+    /*! Значение счётчика раздела l_j, на котором выработан ключ */
+    ak_uint64 l_j;
+    /*! Эпоха сектора (частное l_j_i / v) */
+    ak_uint64 epoch;
+    /*! Производный ключ */
+    ak_uint8 key[32];
+} *ak_dec_key_cache_entry;
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Заголовок сегмента разделяемой памяти, за которым следуют `count` записей кэша. */
+/* ----------------------------------------------------------------------------------------------- */
+typedef struct dec_key_cache_header {
+    /*! Признак завершения инициализации сегмента */
+    ak_uint64 magic;
+    /*! Длина блока алгоритма блочного шифрования */
+    ak_uint64 bsize;
+    /*! Количество записей */
+    ak_uint64 count;
+    /*! Контрольное значение ключа, выработанное функцией ak_dec_key_cache_check_value() */
+    ak_uint8 kcv[16];
+} *ak_dec_key_cache_header;
+
+/*! Список кэшей, подключённых в текущем процессе */
+static ak_dec_key_cache ak_dec_key_caches = NULL;
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция возвращает кэш, подключённый для ключа bkey, либо NULL.                               */
+/* ----------------------------------------------------------------------------------------------- */
+static ak_dec_key_cache ak_dec_key_cache_find(ak_bckey bkey) {
+    ak_dec_key_cache cache = ak_dec_key_caches;
+    while((cache != NULL) && (cache->bkey != bkey)) cache = cache->next;
+    return cache;
+}
+
+#ifdef AK_DEC_SHARED_MEMORY
+/* ----------------------------------------------------------------------------------------------- */
+static ak_dec_key_cache_entry ak_dec_key_cache_slot(ak_dec_key_cache cache, ak_uint64 j, ak_uint64 i,
+                                                    ak_uint64 l_j, ak_uint64 epoch) {
+    ak_uint64 h = j * 0x9e3779b97f4a7c15LL;
+    h = (h ^ i) * 0xbf58476d1ce4e5b9LL;
+    h = (h ^ l_j) * 0x94d049bb133111ebLL;
+    h = (h ^ epoch) * 0x9e3779b97f4a7c15LL;
+    return cache->entries + ((h ^ (h >> 31)) % cache->header->count);
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция захватывает запись, делая значение `seq` нечётным. Барьер release упорядочивает
+    эту запись `seq` перед последующими изменениями данных записи: читатель, увидевший новые
+    данные, увидит и изменённое значение `seq` и отбросит свою копию.                           */
+/* ----------------------------------------------------------------------------------------------- */
+static bool_t ak_dec_key_cache_lock(ak_dec_key_cache_entry entry, ak_uint64 *seq) {
+    *seq = ak_dec_atomic_load(&entry->seq, RELAXED);
+    if(*seq & 1) return ak_false;
+    if(!ak_dec_atomic_cas(&entry->seq, seq, *seq + 1, ACQUIRE)) {
+        return ak_false;
+    }
+    ak_dec_atomic_fence(RELEASE);
+    return ak_true;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция ожидает освобождения записи, уступая процессор между попытками её захвата.
+    Если запись не удаётся захватить за \ref ak_dec_key_cache_lock_attempts попыток (например,
+    изменявший её процесс аварийно завершился), функция возвращает ak_false и запись не изменяется.
+    Ключи ищутся в кэше по номерам раздела и сектора и значениям счётчиков, поэтому неудалённый
+    устаревший ключ никогда не будет выдан вместо актуального.                                  */
+/* ----------------------------------------------------------------------------------------------- */
+static bool_t ak_dec_key_cache_lock_wait(ak_dec_key_cache_entry entry, ak_uint64 *seq) {
+    for(ak_uint64 attempt = 0; attempt < ak_dec_key_cache_lock_attempts; ++attempt) {
+        if(ak_dec_key_cache_lock(entry, seq)) return ak_true;
+ #ifdef LIBAKRYPT_HAVE_PTHREAD_H
+        sched_yield();
+ #endif
+    }
+    return ak_false;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+static void ak_dec_key_cache_unlock(ak_dec_key_cache_entry entry, ak_uint64 seq) {
+    ak_dec_atomic_store(&entry->seq, seq + 2, RELEASE);
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция ищет ключ в кэше; при успехе ключ копируется в key и возвращается ak_true.           */
+/* ----------------------------------------------------------------------------------------------- */
+static bool_t ak_dec_key_cache_get(ak_dec_key_cache cache, ak_uint64 j, ak_uint64 i, ak_uint64 l_j,
+                                   ak_uint64 epoch, ak_uint8 *key) {
+    ak_dec_key_cache_entry entry = ak_dec_key_cache_slot(cache, j, i, l_j, epoch);
+    struct dec_key_cache_entry copy;
+    ak_uint64 seq = ak_dec_atomic_load(&entry->seq, ACQUIRE);
+    bool_t found = ak_false;
+
+    if(seq & 1) return ak_false;
+    memcpy(&copy, entry, sizeof(copy));
+    ak_dec_atomic_fence(ACQUIRE);
+
+    if((ak_dec_atomic_load(&entry->seq, RELAXED) == seq) && copy.used &&
+       (copy.j == j) && (copy.i == i) && (copy.l_j == l_j) && (copy.epoch == epoch)) {
+        memcpy(key, copy.key, sizeof(copy.key));
+        found = ak_true;
+    }
+    ak_dec_wipe(&copy, sizeof(copy));
+    return found;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция помещает ключ в кэш, затирая ключ, ранее хранившийся в той же записи.
+    Если запись в данный момент изменяется другим потоком или процессом, ключ не сохраняется.      */
+/* ----------------------------------------------------------------------------------------------- */
+static void ak_dec_key_cache_put(ak_dec_key_cache cache, ak_uint64 j, ak_uint64 i, ak_uint64 l_j,
+                                 ak_uint64 epoch, ak_uint8 *key) {
+    ak_dec_key_cache_entry entry = ak_dec_key_cache_slot(cache, j, i, l_j, epoch);
+    ak_uint64 seq = 0;
+
+    if(!ak_dec_key_cache_lock(entry, &seq)) return;
+    entry->j = j;
+    entry->i = i;
+    entry->l_j = l_j;
+    entry->epoch = epoch;
+    memcpy(entry->key, key, sizeof(entry->key));
+    entry->used = 1;
+    ak_dec_key_cache_unlock(entry, seq);
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция затирает запись, захваченную функцией \ref ak_dec_key_cache_lock().                   */
+/* ----------------------------------------------------------------------------------------------- */
+static void ak_dec_key_cache_clear(ak_dec_key_cache_entry entry) {
+    entry->used = 0;
+    entry->j = entry->i = entry->l_j = entry->epoch = 0;
+    ak_dec_wipe(entry->key, sizeof(entry->key));
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция удаляет из кэша ключ сектора i раздела j, выработанный для эпохи epoch.              */
+/* ----------------------------------------------------------------------------------------------- */
+static void ak_dec_key_cache_retire_sector(ak_dec_key_cache cache, ak_uint64 j, ak_uint64 i, ak_uint64 l_j,
+                                           ak_uint64 epoch) {
+    ak_dec_key_cache_entry entry = ak_dec_key_cache_slot(cache, j, i, l_j, epoch);
+    ak_uint64 seq = 0;
+
+    if(!ak_dec_key_cache_lock_wait(entry, &seq)) return;
+    if(entry->used && (entry->j == j) && (entry->i == i) && (entry->l_j == l_j) && (entry->epoch == epoch)) {
+        ak_dec_key_cache_clear(entry);
+    }
+    ak_dec_key_cache_unlock(entry, seq);
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция удаляет из кэша все ключи раздела j, выработанные для значений счётчика раздела,
+    меньших l_j, то есть ключ раздела и ключи всех его секторов предыдущих эпох.                   */
+/* ----------------------------------------------------------------------------------------------- */
+static void ak_dec_key_cache_retire_volume(ak_dec_key_cache cache, ak_uint64 j, ak_uint64 l_j) {
+    ak_uint64 seq = 0;
+
+    for(ak_uint64 n = 0; n < cache->header->count; ++n) {
+        ak_dec_key_cache_entry entry = cache->entries + n;
+
+        if(!entry->used || (entry->j != j)) continue;
+        if(!ak_dec_key_cache_lock_wait(entry, &seq)) continue;
+        if(entry->used && (entry->j == j) && (entry->l_j < l_j)) ak_dec_key_cache_clear(entry);
+        ak_dec_key_cache_unlock(entry, seq);
+    }
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция вырабатывает контрольное значение ключа bkey, размещаемое в заголовке кэша.
+    Значение вырабатывается функцией выработки производных ключей с отдельной меткой, длина
+    которой отлична от длин меток ключей разделов, поэтому оно не совпадает ни с одним ключом
+    режима `DEC` и не раскрывает результатов зашифрования на ключе bkey (в частности,
+    зашифрованного нулевого блока, используемого при выработке имитовставки CMAC).
+
+    @return В случае возникновения ошибки функция возвращает ее код, в противном случае
+    возвращается \ref ak_error_ok (ноль)                                                           */
+/* ----------------------------------------------------------------------------------------------- */
+static int ak_dec_key_cache_check_value(ak_bckey bkey, ak_uint8 *kcv, size_t size) {
+    int error = ak_error_ok;
+    ak_uint8 label[] = "libakrypt dec key cache check value";
+    ak_uint8 seed[32] = {0};
+    ak_uint128 z0 = {{0}};
+    struct kdf_state ks;
+
+    error = ak_kdf_state_create(&ks, bkey->key.key, bkey->key.key_size,
+                                (bkey->bsize == 8) ? xor_cmac_magma_kdf : xor_cmac_kuznechik_kdf,
+                                label, sizeof(label) - 1, seed, sizeof(seed),
+                                (ak_uint8 *)&z0, bkey->bsize, 32768);
+    if(error != ak_error_ok) {
+        return ak_error_message(error, __func__, "incorrect creation of kdf state");
+    }
+
+    error = ak_kdf_state_next(&ks, kcv, size);
+    ak_kdf_state_destroy(&ks);
+
+    return error;
+}
+
+#else
+ static bool_t ak_dec_key_cache_get(ak_dec_key_cache cache, ak_uint64 j, ak_uint64 i, ak_uint64 l_j,
+                                    ak_uint64 epoch, ak_uint8 *key) {
+    (void)cache; (void)j; (void)i; (void)l_j; (void)epoch; (void)key;
+    return ak_false;
+ }
+ static void ak_dec_key_cache_put(ak_dec_key_cache cache, ak_uint64 j, ak_uint64 i, ak_uint64 l_j,
+                                  ak_uint64 epoch, ak_uint8 *key) {
+    (void)cache; (void)j; (void)i; (void)l_j; (void)epoch; (void)key;
+ }
+ static void ak_dec_key_cache_retire_sector(ak_dec_key_cache cache, ak_uint64 j, ak_uint64 i, ak_uint64 l_j,
+                                            ak_uint64 epoch) {
+    (void)cache; (void)j; (void)i; (void)l_j; (void)epoch;
+ }
+ static void ak_dec_key_cache_retire_volume(ak_dec_key_cache cache, ak_uint64 j, ak_uint64 l_j) {
+    (void)cache; (void)j; (void)l_j;
+ }
+#endif
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция подключает кэш производных ключей режима `DEC`, размещённый в именованном сегменте
+    разделяемой памяти (POSIX shared memory). Если сегмент с именем name не существует, он
+    создаётся и инициализируется; в противном случае процесс подключается к уже существующему
+    сегменту. Память сегмента блокируется в оперативной памяти и не сбрасывается в файл подкачки.
+
+    Кэш связывается с контекстом bkey: после подключения функции режима `DEC`, вызываемые с этим
+    контекстом, сначала ищут ключи разделов k_j и ключи секторов k_j_i в кэше, а выработанные
+    ключи помещают в кэш, так что ключ, выработанный одним процессом, используется всеми.
+    Ключи хранятся вместе со значениями счётчиков l_j и l_j_i / v, на которых они выработаны;
+    при увеличении этих счётчиков устаревшие ключи затираются.
+
+    Все процессы должны использовать один и тот же ключ и одинаковое количество записей;
+    совпадение ключа проверяется по контрольному значению, выработанному из ключа с отдельной
+    меткой функцией выработки производных ключей.
+    Функции подключения и отключения кэша не должны вызываться одновременно с функциями
+    шифрования в других потоках процесса.
+
+    @param cache Контекст кэша.
+    @param name Имя сегмента разделяемой памяти (в формате функции shm_open(), например "/dec").
+    @param count Количество записей кэша.
+    @param bkey Контекст ключа алгоритма блочного шифрования.
+
+    @return В случае возникновения ошибки функция возвращает ее код, в противном случае
+    возвращается \ref ak_error_ok (ноль)                                                           */
+/* ----------------------------------------------------------------------------------------------- */
+int ak_dec_key_cache_open(ak_dec_key_cache cache, const char *name, size_t count, ak_bckey bkey) {
+#ifdef AK_DEC_SHARED_MEMORY
+    int fd = -1, error = ak_error_ok;
+    bool_t created = ak_true;
+    ak_uint8 kcv[16] = {0};
+    struct stat st;
+    ak_pointer ptr = MAP_FAILED;
+
+    if((cache == NULL) || (name == NULL) || (bkey == NULL)) {
+        return ak_error_message(ak_error_null_pointer, __func__, "using null pointer to dec key cache parameter");
+    }
+    if(count == 0) {
+        return ak_error_message(ak_error_zero_length, __func__, "using zero number of cache entries");
+    }
+    if((bkey->bsize != 8) && (bkey->bsize != 16)) {
+        return ak_error_message(ak_error_wrong_block_cipher, __func__ , "incorrect block size of block cipher key");
+    }
+    if(strlen(name) >= sizeof(cache->name)) {
+        return ak_error_message(ak_error_wrong_length, __func__, "name of shared memory segment is too long");
+    }
+
+    memset(cache, 0, sizeof(struct dec_key_cache));
+    cache->size = sizeof(struct dec_key_cache_header) + count * sizeof(struct dec_key_cache_entry);
+    if((error = ak_dec_key_cache_check_value(bkey, kcv, sizeof(kcv))) != ak_error_ok) {
+        memset(cache, 0, sizeof(struct dec_key_cache));
+        return ak_error_message(error, __func__, "incorrect generation of key check value");
+    }
+
+    if((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR)) < 0) {
+        created = ak_false;
+        if((fd = shm_open(name, O_RDWR, 0)) < 0) {
+            error = ak_error_message(ak_error_open_file, __func__, "wrong opening of shared memory segment");
+            goto ext;
+        }
+    }
+
+    if(created) {
+        if(ftruncate(fd, (off_t)cache->size) != 0) {
+            error = ak_error_message(ak_error_out_of_memory, __func__, "wrong resizing of shared memory segment");
+            goto ext;
+        }
+    } else {
+        /* ожидаем, пока создавший сегмент процесс установит его размер */
+        for(int attempt = 0; attempt < 1000; ++attempt) {
+            if(fstat(fd, &st) != 0) break;
+            if(st.st_size != 0) break;
+            usleep(1000);
+        }
+        if((fstat(fd, &st) != 0) || ((size_t)st.st_size != cache->size)) {
+            error = ak_error_message(ak_error_wrong_length, __func__,
+                                     "shared memory segment has unexpected size or number of entries");
+            goto ext;
+        }
+    }
+
+    if((ptr = mmap(NULL, cache->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        error = ak_error_message(ak_error_out_of_memory, __func__, "wrong mapping of shared memory segment");
+        goto ext;
+    }
+    if(mlock(ptr, cache->size) != 0) {
+        error = ak_error_message(ak_error_out_of_memory, __func__, "wrong locking of shared memory segment");
+        goto ext;
+    }
+  #ifdef MADV_DONTDUMP
+    madvise(ptr, cache->size, MADV_DONTDUMP);
+  #endif
+    cache->header = (ak_dec_key_cache_header)ptr;
+    cache->entries = (ak_dec_key_cache_entry)(cache->header + 1);
+
+    if(created) {
+        cache->header->bsize = bkey->bsize;
+        cache->header->count = count;
+        memcpy(cache->header->kcv, kcv, sizeof(kcv));
+        ak_dec_atomic_store(&cache->header->magic, ak_dec_key_cache_magic, RELEASE);
+    } else {
+        for(int attempt = 0; attempt < 1000; ++attempt) {
+            if(ak_dec_atomic_load(&cache->header->magic, ACQUIRE) == ak_dec_key_cache_magic) break;
+            usleep(1000);
+        }
+        if((ak_dec_atomic_load(&cache->header->magic, ACQUIRE) != ak_dec_key_cache_magic) ||
+           (cache->header->bsize != bkey->bsize) || (cache->header->count != count)) {
+            error = ak_error_message(ak_error_wrong_length, __func__, "shared memory segment is not a dec key cache");
+            goto ext;
+        }
+        if(memcmp(cache->header->kcv, kcv, sizeof(kcv)) != 0) {
+            error = ak_error_message(ak_error_wrong_key_icode, __func__,
+                                     "dec key cache was created for another secret key");
+            goto ext;
+        }
+    }
+
+    strcpy(cache->name, name);
+    cache->bkey = bkey;
+    cache->next = ak_dec_key_caches;
+    ak_dec_key_caches = cache;
+
+ext:
+    ak_dec_wipe(kcv, sizeof(kcv));
+    if(fd >= 0) close(fd);
+    if(error != ak_error_ok) {
+        if(ptr != MAP_FAILED) {
+            munlock(ptr, cache->size);
+            munmap(ptr, cache->size);
+        }
+        if(created && (fd >= 0)) shm_unlink(name);
+        memset(cache, 0, sizeof(struct dec_key_cache));
+    }
+    return error;
+#else
+    (void)cache; (void)name; (void)count; (void)bkey;
+    return ak_error_message(ak_error_undefined_function, __func__,
+                            "shared memory is not supported on this platform");
+#endif
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция отключает кэш от текущего процесса. Сегмент разделяемой памяти и хранящиеся в нём ключи
+    остаются доступны другим процессам.
+
+    @param cache Контекст кэша.
+    @return В случае возникновения ошибки функция возвращает ее код, в противном случае
+    возвращается \ref ak_error_ok (ноль)                                                           */
+/* ----------------------------------------------------------------------------------------------- */
+int ak_dec_key_cache_close(ak_dec_key_cache cache) {
+    ak_dec_key_cache *ptr = &ak_dec_key_caches;
+
+    if(cache == NULL) {
+        return ak_error_message(ak_error_null_pointer, __func__, "using null pointer to dec key cache");
+    }
+    while((*ptr != NULL) && (*ptr != cache)) ptr = &(*ptr)->next;
+    if(*ptr == NULL) {
+        return ak_error_message(ak_error_undefined_value, __func__, "dec key cache is not opened");
+    }
+    *ptr = cache->next;
+
+#ifdef AK_DEC_SHARED_MEMORY
+    munlock(cache->header, cache->size);
+    munmap(cache->header, cache->size);
+#endif
+    memset(cache, 0, sizeof(struct dec_key_cache));
+    return ak_error_ok;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция затирает все ключи, хранящиеся в кэше, удаляет сегмент разделяемой памяти
+    и отключает кэш от текущего процесса. Записи, остающиеся захваченными другим процессом
+    (например, аварийно завершившимся), не затираются; их память освобождается вместе
+    с сегментом после его отключения всеми процессами.
+
+    @param cache Контекст кэша.
+    @return В случае возникновения ошибки функция возвращает ее код, в противном случае
+    возвращается \ref ak_error_ok (ноль)                                                           */
+/* ----------------------------------------------------------------------------------------------- */
+int ak_dec_key_cache_destroy(ak_dec_key_cache cache) {
+#ifdef AK_DEC_SHARED_MEMORY
+    ak_uint64 seq = 0;
+
+    if((cache == NULL) || (cache->header == NULL)) {
+        return ak_error_message(ak_error_null_pointer, __func__, "using null pointer to dec key cache");
+    }
+    for(ak_uint64 n = 0; n < cache->header->count; ++n) {
+        if(!ak_dec_key_cache_lock_wait(cache->entries + n, &seq)) continue;
+        ak_dec_key_cache_clear(cache->entries + n);
+        ak_dec_key_cache_unlock(cache->entries + n, seq);
+    }
+    shm_unlink(cache->name);
+#endif
+    return ak_dec_key_cache_close(cache);
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция возвращает ключ раздела k_j, используя кэш производных ключей, если он подключён.     */
+/* ----------------------------------------------------------------------------------------------- */
+static int ak_dec_volume_key(ak_dec_workspace ws, ak_dec_key_cache cache, ak_bckey bkey, ak_uint64 j,
+                             ak_uint64 l_j, ak_uint8 *k_j) {
+    int error = ak_error_ok;
+
+    if((cache != NULL) && ak_dec_key_cache_get(cache, j, ak_dec_key_cache_volume, l_j, 0, k_j)) {
+        return ak_error_ok;
+    }
+    if((error = ak_dec_derive_volume_key(ws, bkey, j, l_j, k_j)) != ak_error_ok) return error;
+    if(cache != NULL) ak_dec_key_cache_put(cache, j, ak_dec_key_cache_volume, l_j, 0, k_j);
+
+    return error;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция возвращает ключ сектора k_j_i, используя кэш производных ключей, если он подключён.   */
+/* ----------------------------------------------------------------------------------------------- */
+static int ak_dec_sector_key(ak_dec_workspace ws, ak_dec_key_cache cache, size_t bsize, ak_uint8 *k_j,
+                             ak_uint64 j, ak_uint64 l_j, ak_uint64 i, ak_uint64 epoch, ak_uint8 *k_j_i) {
+    int error = ak_error_ok;
+
+    if((cache != NULL) && ak_dec_key_cache_get(cache, j, i, l_j, epoch, k_j_i)) {
+        return ak_error_ok;
+    }
+    if((error = ak_dec_derive_sector_key(ws, bsize, k_j, j, i, epoch, k_j_i)) != ak_error_ok) return error;
+    if(cache != NULL) ak_dec_key_cache_put(cache, j, i, l_j, epoch, k_j_i);
+
+    return error;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция помещает в ws->k_j ключ раздела j. Если рабочая область уже содержит ключ, выработанный
+    для того же ключа bkey, раздела j и значения счётчика l_j, он используется повторно; это
+    позволяет не вырабатывать ключи разделов заново при обработке нескольких массивов данных
+    на одном ключе.                                                                                */
+/* ----------------------------------------------------------------------------------------------- */
+static int ak_dec_workspace_volume_key(ak_dec_workspace ws, ak_dec_key_cache cache, ak_bckey bkey,
+                                       ak_uint64 j, ak_uint64 l_j) {
+    int error = ak_error_ok;
+
+    if((ws->k_j_bkey == bkey) && (ws->k_j_number == j) && (ws->k_j_counter == l_j)) return ak_error_ok;
+
+    ws->k_j_bkey = NULL;
+    if((error = ak_dec_volume_key(ws, cache, bkey, j, l_j, ws->k_j)) != ak_error_ok) return error;
+    ws->k_j_bkey = bkey;
+    ws->k_j_number = j;
+    ws->k_j_counter = l_j;
+
+    return error;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*                        выработка гаммы алгоритма Кузнечик для сектора                           */
+/* ----------------------------------------------------------------------------------------------- */
+/*! Нелинейная подстановка Pi алгоритма Кузнечик (ГОСТ Р 34.12-2015). */
+static const ak_uint8 ak_dec_kuznechik_pi[256] = {
+    0xfc, 0xee, 0xdd, 0x11, 0xcf, 0x6e, 0x31, 0x16, 0xfb, 0xc4, 0xfa, 0xda, 0x23, 0xc5, 0x04, 0x4d,
+    0xe9, 0x77, 0xf0, 0xdb, 0x93, 0x2e, 0x99, 0xba, 0x17, 0x36, 0xf1, 0xbb, 0x14, 0xcd, 0x5f, 0xc1,
+    0xf9, 0x18, 0x65, 0x5a, 0xe2, 0x5c, 0xef, 0x21, 0x81, 0x1c, 0x3c, 0x42, 0x8b, 0x01, 0x8e, 0x4f,
+    0x05, 0x84, 0x02, 0xae, 0xe3, 0x6a, 0x8f, 0xa0, 0x06, 0x0b, 0xed, 0x98, 0x7f, 0xd4, 0xd3, 0x1f,
+    0xeb, 0x34, 0x2c, 0x51, 0xea, 0xc8, 0x48, 0xab, 0xf2, 0x2a, 0x68, 0xa2, 0xfd, 0x3a, 0xce, 0xcc,
+    0xb5, 0x70, 0x0e, 0x56, 0x08, 0x0c, 0x76, 0x12, 0xbf, 0x72, 0x13, 0x47, 0x9c, 0xb7, 0x5d, 0x87,
+    0x15, 0xa1, 0x96, 0x29, 0x10, 0x7b, 0x9a, 0xc7, 0xf3, 0x91, 0x78, 0x6f, 0x9d, 0x9e, 0xb2, 0xb1,
+    0x32, 0x75, 0x19, 0x3d, 0xff, 0x35, 0x8a, 0x7e, 0x6d, 0x54, 0xc6, 0x80, 0xc3, 0xbd, 0x0d, 0x57,
+    0xdf, 0xf5, 0x24, 0xa9, 0x3e, 0xa8, 0x43, 0xc9, 0xd7, 0x79, 0xd6, 0xf6, 0x7c, 0x22, 0xb9, 0x03,
+    0xe0, 0x0f, 0xec, 0xde, 0x7a, 0x94, 0xb0, 0xbc, 0xdc, 0xe8, 0x28, 0x50, 0x4e, 0x33, 0x0a, 0x4a,
+    0xa7, 0x97, 0x60, 0x73, 0x1e, 0x00, 0x62, 0x44, 0x1a, 0xb8, 0x38, 0x82, 0x64, 0x9f, 0x26, 0x41,
+    0xad, 0x45, 0x46, 0x92, 0x27, 0x5e, 0x55, 0x2f, 0x8c, 0xa3, 0xa5, 0x7d, 0x69, 0xd5, 0x95, 0x3b,
+    0x07, 0x58, 0xb3, 0x40, 0x86, 0xac, 0x1d, 0xf7, 0x30, 0x37, 0x6b, 0xe4, 0x88, 0xd9, 0xe7, 0x89,
+    0xe1, 0x1b, 0x83, 0x49, 0x4c, 0x3f, 0xf8, 0xfe, 0x8d, 0x53, 0xaa, 0x90, 0xca, 0xd8, 0x85, 0x61,
+    0x20, 0x71, 0x67, 0xa4, 0x2d, 0x2b, 0x09, 0x5b, 0xcb, 0x9b, 0x25, 0xd0, 0xbe, 0xe5, 0x6c, 0x52,
+    0x59, 0xa6, 0x74, 0xd2, 0xe6, 0xf4, 0xb4, 0xc0, 0xd1, 0x66, 0xaf, 0xc2, 0x39, 0x4b, 0x63, 0xb6
+};
+
+/*! Функция выработки гаммы алгоритма Кузнечик для q блоков сектора (см. \ref ak_dec_xor_sector()). */
+typedef void (ak_dec_kuznechik_ctr_function)(const ak_uint128 *, ak_uint64 , ak_uint64 , ak_uint64 ,
+                                              const ak_uint64 *, ak_uint64 *);
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Таблицы алгоритма Кузнечик, вычисляемые при первом обращении функцией
+    \ref ak_dec_kuznechik_init(). Блоки, как и в библиотеке, представляются массивами
+    из 16 октетов, в которых младший октет блока имеет индекс ноль.                               */
+/* ----------------------------------------------------------------------------------------------- */
+static struct dec_kuznechik_tables {
+    /*! Вклады октетов блока в преобразование LS: ls[k][v] = L(Pi(v) e_k), где e_k -- блок,
+        октет k которого равен единице, а остальные -- нулю; LS(x) = ls[0][x_0] + ... + ls[15][x_15] */
+    ak_uint64 ls[16][256][2];
+    /*! Итерационные константы развёртки ключа C_1, ..., C_32 */
+    ak_uint128 c[32];
+#ifdef AK_DEC_KUZNECHIK_GFNI
+    /*! Подстановка Pi, записанная в представлении поля с модулем x^8 + x^4 + x^3 + x + 1,
+        с которым работают инструкции GFNI */
+    ak_uint8 pi[256];
+    /*! Коэффициенты преобразования L в том же представлении: l[k][j] -- множитель, с которым
+        октет k блока входит в октет j результата */
+    ak_uint8 l[16][16];
+    /*! Матрицы инструкции GF2P8AFFINEQB для перехода к этому представлению и обратно */
+    ak_uint64 to, from;
+#endif
+} ak_dec_kuznechik;
+
+/*! Используемая функция выработки гаммы алгоритма Кузнечик. */
+static ak_dec_kuznechik_ctr_function *ak_dec_kuznechik_ctr = NULL;
+
+#ifdef LIBAKRYPT_HAVE_PTHREAD_H
+ static pthread_once_t ak_dec_kuznechik_once = PTHREAD_ONCE_INIT;
+#endif
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция умножает элементы поля GF(2^8), заданного модулем x^8 + poly.                        */
+/* ----------------------------------------------------------------------------------------------- */
+static ak_uint8 ak_dec_gf_mul(ak_uint8 a, ak_uint8 b, ak_uint8 poly) {
+    ak_uint8 r = 0;
+
+    while(b) {
+        if(b & 1) r ^= a;
+        a = (ak_uint8)((a << 1) ^ ((a & 0x80) ? poly : 0));
+        b >>= 1;
+    }
+    return r;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция вычисляет линейное преобразование L = R^16 алгоритма Кузнечик непосредственно по
+    определению; используется только при вычислении таблиц.                                      */
+/* ----------------------------------------------------------------------------------------------- */
+static void ak_dec_kuznechik_linear(ak_uint8 *b) {
+    static const ak_uint8 lc[16] = { 1, 148, 32, 133, 16, 194, 192, 1, 251, 1, 192, 194, 16, 133, 32, 148 };
+
+    for(size_t r = 0; r < 16; ++r) {
+        ak_uint8 x = 0;
+        for(size_t k = 0; k < 16; ++k) x ^= ak_dec_gf_mul(b[k], lc[k], 0xc3);
+        memmove(b, b + 1, 15);
+        b[15] = x;
+    }
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция вычисляет преобразование LSX[k] алгоритма Кузнечик по таблицам.                      */
+/* ----------------------------------------------------------------------------------------------- */
+static inline void ak_dec_kuznechik_lsx(const ak_uint128 *k, ak_uint128 *x) {
+    ak_uint128 t;
+    ak_uint64 y0 = 0, y1 = 0;
+
+    t.q[0] = x->q[0] ^ k->q[0];
+    t.q[1] = x->q[1] ^ k->q[1];
+    for(size_t n = 0; n < 16; ++n) {
+        y0 ^= ak_dec_kuznechik.ls[n][t.b[n]][0];
+        y1 ^= ak_dec_kuznechik.ls[n][t.b[n]][1];
+    }
+    x->q[0] = y0;
+    x->q[1] = y1;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция разворачивает ключ алгоритма Кузнечик, заданный так же, как для функции
+    ak_bckey_set_key(), в раундовые ключи K_1, ..., K_10.                                        */
+/* ----------------------------------------------------------------------------------------------- */
+static void ak_dec_kuznechik_schedule_keys(const ak_uint8 *key, ak_uint128 *rk) {
+    ak_uint128 a[3];
+
+    memcpy(a[1].b, key + 16, 16);
+    memcpy(a[0].b, key, 16);
+    rk[0] = a[1];
+    rk[1] = a[0];
+    for(size_t n = 0; n < 32; ++n) {
+        a[2] = a[1];
+        ak_dec_kuznechik_lsx(&ak_dec_kuznechik.c[n], &a[2]);
+        a[2].q[0] ^= a[0].q[0];
+        a[2].q[1] ^= a[0].q[1];
+        a[0] = a[1];
+        a[1] = a[2];
+        if((n & 7) == 7) {
+            rk[2 * (n / 8) + 2] = a[1];
+            rk[2 * (n / 8) + 3] = a[0];
+        }
+    }
+    ak_dec_wipe(a, sizeof(a));
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Переносимая функция выработки гаммы алгоритма Кузнечик: блоки обрабатываются группами по
+    \ref ak_dec_kuznechik_lanes, и выборки из таблиц для разных блоков группы чередуются.
+
+    @param rk Раундовые ключи.
+    @param i Номер сектора в разделе (старшая половина счётчика).
+    @param ctr Начальное значение младшей половины счётчика.
+    @param q Количество блоков.
+    @param in Указатель на входные данные.
+    @param out Указатель на выходные данные (может совпадать с in).                               */
+/* ----------------------------------------------------------------------------------------------- */
+static void ak_dec_kuznechik_ctr_generic(const ak_uint128 *rk, ak_uint64 i, ak_uint64 ctr, ak_uint64 q,
+                                         const ak_uint64 *in, ak_uint64 *out) {
+    ak_uint128 x[ak_dec_kuznechik_lanes], y[ak_dec_kuznechik_lanes];
+
+    for(ak_uint64 t = 0; t < q; t += ak_dec_kuznechik_lanes) {
+        size_t lanes = (q - t < ak_dec_kuznechik_lanes) ? (size_t)(q - t) : ak_dec_kuznechik_lanes;
+
+        for(size_t n = 0; n < lanes; ++n) {
+            x[n].q[0] = ctr + t + n;
+            x[n].q[1] = i;
+        }
+        for(size_t r = 0; r < 9; ++r) {
+            for(size_t n = 0; n < lanes; ++n) {
+                x[n].q[0] ^= rk[r].q[0];
+                x[n].q[1] ^= rk[r].q[1];
+                y[n].q[0] = y[n].q[1] = 0;
+            }
+            for(size_t k = 0; k < 16; ++k) {
+                for(size_t n = 0; n < lanes; ++n) {
+                    y[n].q[0] ^= ak_dec_kuznechik.ls[k][x[n].b[k]][0];
+                    y[n].q[1] ^= ak_dec_kuznechik.ls[k][x[n].b[k]][1];
+                }
+            }
+            memcpy(x, y, lanes * sizeof(ak_uint128));
+        }
+        for(size_t n = 0; n < lanes; ++n) {
+            out[2 * (t + n)] = in[2 * (t + n)] ^ x[n].q[0] ^ rk[9].q[0];
+            out[2 * (t + n) + 1] = in[2 * (t + n) + 1] ^ x[n].q[1] ^ rk[9].q[1];
+        }
+    }
+    ak_dec_wipe(x, sizeof(x));
+    ak_dec_wipe(y, sizeof(y));
+}
+
+#ifdef AK_DEC_KUZNECHIK_GFNI
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция возвращает матрицу инструкции GF2P8AFFINEQB для линейного отображения октетов,
+    заданного таблицей значений f.                                                                 */
+/* ----------------------------------------------------------------------------------------------- */
+static ak_uint64 ak_dec_gfni_matrix(const ak_uint8 *f) {
+    ak_uint64 matrix = 0;
+
+    for(size_t row = 0; row < 8; ++row) {
+        ak_uint64 bits = 0;
+        for(size_t col = 0; col < 8; ++col) bits |= (ak_uint64)((f[1 << col] >> row) & 1) << col;
+        matrix |= bits << (8 * (7 - row));
+    }
+    return matrix;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция вычисляет один раунд LSX алгоритма Кузнечик для четырёх блоков, размещённых в x,
+    в представлении поля инструкций GFNI. Подстановка выполняется двумя выборками из 128-октетных
+    половин таблицы, преобразование L -- умножением октетов, размноженных по всему блоку,
+    на столбцы его матрицы.                                                                        */
+/* ----------------------------------------------------------------------------------------------- */
+__attribute__((target("avx512f,avx512bw,avx512vbmi,gfni")))
+static inline __m512i ak_dec_kuznechik_gfni_round(__m512i x, __m512i key, const __m512i *pi,
+                                                  const __m512i *column, const __m512i *spread) {
+    __m512i y;
+    __mmask64 high;
+
+    x = _mm512_xor_si512(x, key);
+    high = _mm512_movepi8_mask(x);
+    x = _mm512_mask_blend_epi8(high, _mm512_permutex2var_epi8(pi[0], x, pi[1]),
+                                     _mm512_permutex2var_epi8(pi[2], x, pi[3]));
+    y = _mm512_gf2p8mul_epi8(_mm512_shuffle_epi8(x, spread[0]), column[0]);
+    for(size_t k = 1; k < 16; ++k) {
+        y = _mm512_xor_si512(y, _mm512_gf2p8mul_epi8(_mm512_shuffle_epi8(x, spread[k]), column[k]));
+    }
+    return y;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция выработки гаммы алгоритма Кузнечик с инструкциями AVX-512 и GFNI: за один проход
+    обрабатываются \ref ak_dec_kuznechik_gfni_blocks блоков, по четыре в каждом регистре.
+    Оставшиеся блоки сектора обрабатываются переносимой реализацией.                              */
+/* ----------------------------------------------------------------------------------------------- */
+__attribute__((target("avx512f,avx512bw,avx512vbmi,gfni")))
+static void ak_dec_kuznechik_ctr_gfni(const ak_uint128 *rk, ak_uint64 i, ak_uint64 ctr, ak_uint64 q,
+                                      const ak_uint64 *in, ak_uint64 *out) {
+    __m512i pi[4], column[16], spread[16], key[10], x[4];
+    __m512i to = _mm512_set1_epi64((long long)ak_dec_kuznechik.to);
+    __m512i from = _mm512_set1_epi64((long long)ak_dec_kuznechik.from);
+    __m512i step = _mm512_set_epi64(0, 3, 0, 2, 0, 1, 0, 0);
+    ak_uint64 t = 0;
+
+    for(size_t h = 0; h < 4; ++h) pi[h] = _mm512_loadu_si512(ak_dec_kuznechik.pi + 64 * h);
+    for(size_t k = 0; k < 16; ++k) {
+        column[k] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)ak_dec_kuznechik.l[k]));
+        spread[k] = _mm512_set1_epi8((char)k);
+    }
+    for(size_t r = 0; r < 10; ++r) {
+        key[r] = _mm512_gf2p8affine_epi64_epi8(_mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)(rk + r))),
+                                               to, 0);
+    }
+
+    for(; t + ak_dec_kuznechik_gfni_blocks <= q; t += ak_dec_kuznechik_gfni_blocks) {
+        for(size_t n = 0; n < 4; ++n) {
+            __m512i c = _mm512_set_epi64((long long)i, (long long)(ctr + t + 4 * n), (long long)i,
+                                         (long long)(ctr + t + 4 * n), (long long)i, (long long)(ctr + t + 4 * n),
+                                         (long long)i, (long long)(ctr + t + 4 * n));
+            x[n] = _mm512_gf2p8affine_epi64_epi8(_mm512_add_epi64(c, step), to, 0);
+        }
+        for(size_t r = 0; r < 9; ++r) {
+            for(size_t n = 0; n < 4; ++n) x[n] = ak_dec_kuznechik_gfni_round(x[n], key[r], pi, column, spread);
+        }
+        for(size_t n = 0; n < 4; ++n) {
+            __m512i gamma = _mm512_gf2p8affine_epi64_epi8(_mm512_xor_si512(x[n], key[9]), from, 0);
+            _mm512_storeu_si512(out + 2 * (t + 4 * n),
+                                _mm512_xor_si512(gamma, _mm512_loadu_si512(in + 2 * (t + 4 * n))));
+        }
+    }
+    for(size_t r = 0; r < 10; ++r) key[r] = _mm512_setzero_si512();
+    for(size_t n = 0; n < 4; ++n) x[n] = _mm512_setzero_si512();
+    _mm256_zeroupper();
+
+    if(t < q) ak_dec_kuznechik_ctr_generic(rk, i, ctr + t, q - t, in + 2 * t, out + 2 * t);
+}
+#endif
+
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция вычисляет таблицы алгоритма Кузнечик и выбирает функцию выработки гаммы: реализацию
+    с инструкциями GFNI, если процессор поддерживает GFNI и AVX-512 (F, BW, VBMI), иначе
+    переносимую реализацию.                                                                        */
+/* ----------------------------------------------------------------------------------------------- */
+static void ak_dec_kuznechik_init(void) {
+    ak_uint8 column[16][16], b[16];
+
+    for(size_t k = 0; k < 16; ++k) {
+        memset(column[k], 0, 16);
+        column[k][k] = 1;
+        ak_dec_kuznechik_linear(column[k]);
+    }
+    for(size_t k = 0; k < 16; ++k) {
+        for(size_t v = 0; v < 256; ++v) {
+            for(size_t j = 0; j < 16; ++j) b[j] = ak_dec_gf_mul(column[k][j], ak_dec_kuznechik_pi[v], 0xc3);
+            memcpy(ak_dec_kuznechik.ls[k][v], b, 16);
+        }
+    }
+    for(size_t n = 0; n < 32; ++n) {
+        memset(b, 0, 16);
+        b[0] = (ak_uint8)(n + 1);
+        ak_dec_kuznechik_linear(b);
+        memcpy(ak_dec_kuznechik.c[n].b, b, 16);
+    }
+    ak_dec_kuznechik_ctr = ak_dec_kuznechik_ctr_generic;
+
+#ifdef AK_DEC_KUZNECHIK_GFNI
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+       __builtin_cpu_supports("avx512vbmi") && __builtin_cpu_supports("gfni")) {
+        ak_uint8 to[256], from[256], beta = 0;
+
+        /* корень модуля x^8 + x^7 + x^6 + x + 1 в поле инструкций GFNI задаёт изоморфизм полей */
+        for(size_t c = 2; (c < 256) && (beta == 0); ++c) {
+            ak_uint8 p[9];
+            p[0] = 1;
+            for(size_t k = 1; k < 9; ++k) p[k] = ak_dec_gf_mul(p[k - 1], (ak_uint8)c, 0x1b);
+            if((p[8] ^ p[7] ^ p[6] ^ p[1] ^ p[0]) == 0) beta = (ak_uint8)c;
+        }
+        for(size_t v = 0; v < 256; ++v) {
+            ak_uint8 power = 1;
+            to[v] = 0;
+            for(size_t k = 0; k < 8; ++k) {
+                if((v >> k) & 1) to[v] ^= power;
+                power = ak_dec_gf_mul(power, beta, 0x1b);
+            }
+        }
+        for(size_t v = 0; v < 256; ++v) from[to[v]] = (ak_uint8)v;
+        for(size_t v = 0; v < 256; ++v) ak_dec_kuznechik.pi[v] = to[ak_dec_kuznechik_pi[from[v]]];
+        for(size_t k = 0; k < 16; ++k) {
+            for(size_t j = 0; j < 16; ++j) ak_dec_kuznechik.l[k][j] = to[column[k][j]];
+        }
+        ak_dec_kuznechik.to = ak_dec_gfni_matrix(to);
+        ak_dec_kuznechik.from = ak_dec_gfni_matrix(from);
+        ak_dec_kuznechik_ctr = ak_dec_kuznechik_ctr_gfni;
+    }
+#endif
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция возвращает функцию выработки гаммы алгоритма Кузнечик, при первом обращении вычисляя
+    таблицы алгоритма.                                                                             */
+/* ----------------------------------------------------------------------------------------------- */
+static ak_dec_kuznechik_ctr_function *ak_dec_kuznechik_prepare(void) {
+#ifdef LIBAKRYPT_HAVE_PTHREAD_H
+    pthread_once(&ak_dec_kuznechik_once, ak_dec_kuznechik_init);
+#else
+    if(ak_dec_kuznechik_ctr == NULL) ak_dec_kuznechik_init();
+#endif
+    return ak_dec_kuznechik_ctr;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция вырабатывает гамму для q блоков сектора с номером i и накладывает её на данные.
+    Ключ сектора разворачивается один раз для всех блоков сектора. Для алгоритма Кузнечик
+    раундовые ключи размещаются в рабочей области ws, а гамма вырабатывается сразу для нескольких
+    блоков функцией, выбранной при первом обращении (\ref ak_dec_kuznechik_init()). Для алгоритма
+    Магма используется контекст ключа сектора, создаваемый один раз для рабочей области; перед
+    присвоением нового ключа прежние раундовые ключи контекста уничтожаются.
+
+    @param ws Рабочая область.
+    @param bsize Длина блока используемого алгоритма блочного шифрования.
+    @param k_j_i Ключ сектора.
+    @param i Номер сектора в разделе.
+    @param ctr Начальное значение младшей половины счётчика.
+    @param q Количество блоков в секторе.
+    @param inptr Указатель на входные данные сектора.
+    @param outptr Указатель на выходные данные сектора.
+
+    @return В случае возникновения ошибки функция возвращает ее код, в противном случае
+    возвращается \ref ak_error_ok (ноль)                                                           */
+/* ----------------------------------------------------------------------------------------------- */
+static int ak_dec_xor_sector(ak_dec_workspace ws, size_t bsize, ak_uint8 *k_j_i, ak_uint64 i, ak_uint64 ctr,
+                             ak_uint64 q, ak_uint64 *inptr, ak_uint64 *outptr) {
+    int error = ak_error_ok;
+    ak_bckey internalContext = &ws->context;
+
+    if(bsize == 16) {
+        ak_dec_kuznechik_ctr_function *kernel = ak_dec_kuznechik_prepare();
+
+        ak_dec_kuznechik_schedule_keys(k_j_i, ws->round_keys);
+        kernel(ws->round_keys, i, ctr, q, inptr, outptr);
+        return ak_error_ok;
+    }
+
+    if(ws->context_bsize == 0) {
+        if((error = ak_bckey_create_magma(internalContext)) != ak_error_ok ) {
+            return ak_error_message( error, __func__, "incorrect creation of magma secret key" );
+        }
+        ws->context_bsize = bsize;
+    } else if(internalContext->delete_keys != NULL) {
+        internalContext->delete_keys(&internalContext->key);
+    }
+    if((error = ak_bckey_set_key(internalContext, k_j_i, 32)) != ak_error_ok) {
+        return ak_error_message(error, __func__, "incorrect assigning a sector key value");
+    }
+
+    for (ak_uint64 t = 0; t < q; ++t) {
+        ws->ctr[0] = i;
+        ws->ctr[0] <<= sizeof(ws->ctr[0]) * 8 / 2;
+        ws->ctr[0] = ws->ctr[0] + ctr + t;
+        internalContext->encrypt(&internalContext->key, ws->ctr, ws->gamma);
+
+        outptr[0] = inptr[0] ^ ws->gamma[0];
+        inptr++;
+        outptr++;
+    }
+
+    return error;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция перешифровывает секторы раздела j на новых ключах: счётчик раздела l_j увеличивается,
+    счётчики секторов обнуляются. Секторы с номерами i >= first, отмеченные в битовой шкале dirty
+    (если dirty равен NULL -- все такие секторы), ещё не зашифрованы текущим вызовом функции
+    зашифрования: их данные не изменяются (при зашифровании на месте там находится открытый текст),
+    обнуляются только счётчики. Указатели in, out, l_j и l_j_i указывают на данные и счётчики
+    раздела j, параметры предполагаются проверенными.
+
+    @return В случае возникновения ошибки функция возвращает ее код, в противном случае
+    возвращается \ref ak_error_ok (ноль)                                                           */
+/* ----------------------------------------------------------------------------------------------- */
+static int ak_dec_re_encrypt_sectors(ak_bckey bkey, ak_pointer in, ak_pointer out, ak_uint64 s, ak_uint64 v,
+                                     ak_uint64 l, ak_pointer l_j, ak_pointer l_j_i, ak_uint64 j,
+                                     ak_uint64 first, const ak_uint8 *dirty) {
+    int error = ak_error_ok;
+    ak_uint64 q = l / bkey->bsize;
+    ak_uint64 words = l / sizeof(ak_uint64);
+    ak_uint64 l_j_old = 0;
+    ak_uint64 l_j_i_old = 0;
+    ak_dec_key_cache cache = NULL;
+    struct dec_workspace local;
+    ak_dec_arena arena = NULL;
+    size_t mark = 0;
+    ak_dec_workspace ws = NULL;
+
+    if((ws = ak_dec_workspace_acquire(&local, &arena, &mark)) == NULL) return ak_error_out_of_memory;
+    if((l_j_old = ak_dec_counter_get(bkey->bsize, l_j, 0)) == ak_dec_counter_max(bkey->bsize)) {
+        error = ak_error_wrong_key_icode;
+        ak_error_message(error, __func__, "Key_in is can not be used anymore");
+        goto ext;
+    }
+
+    cache = ak_dec_key_cache_find(bkey);
+    if((error = ak_dec_volume_key(ws, cache, bkey, j, l_j_old, ws->k_j)) != ak_error_ok) {
+        goto ext;
+    }
+    if((error = ak_dec_volume_key(ws, cache, bkey, j, l_j_old + 1, ws->k_j_sh)) != ak_error_ok) {
+        goto ext;
+    }
+
+    for(ak_uint64 i = 0; i < s; ++i) {
+        ak_uint64 *inptr = (ak_uint64 *)in + i * words;
+        ak_uint64 *outptr = (ak_uint64 *)out + i * words;
+
+        l_j_i_old = ak_dec_counter_get(bkey->bsize, l_j_i, i);
+        ak_dec_counter_set(bkey->bsize, l_j_i, i, 0);
+        if((i >= first) && ((dirty == NULL) || ak_dec_dirty_bit(dirty, j * s + i))) continue;
+
+        if((error = ak_dec_sector_key(ws, cache, bkey->bsize, ws->k_j, j, l_j_old, i, l_j_i_old / v,
+                                      ws->k_j_i)) != ak_error_ok) {
+            goto ext;
+        }
+        if((error = ak_dec_sector_key(ws, cache, bkey->bsize, ws->k_j_sh, j, l_j_old + 1, i, 0,
+                                      ws->k_j_i_sh)) != ak_error_ok) {
+            goto ext;
+        }
+
+        /* снимаем гамму, выработанную на прежних ключах, и накладываем гамму на новых ключах */
+        if((error = ak_dec_xor_sector(ws, bkey->bsize, ws->k_j_i, i, l_j_i_old * q, q, inptr, outptr)) != ak_error_ok) {
+            goto ext;
+        }
+        if((error = ak_dec_xor_sector(ws, bkey->bsize, ws->k_j_i_sh, i, 0, q, outptr, outptr)) != ak_error_ok) {
+            goto ext;
+        }
+    }
+
+    ak_dec_counter_set(bkey->bsize, l_j, 0, l_j_old + 1);
+    if(cache != NULL) {
+        ak_dec_key_cache_retire_volume(cache, j, l_j_old + 1);
+    }
+
+ext:
+    ak_dec_workspace_release(ws, arena, mark);
+    return error;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция перешифровывает раздел j выходных данных при исчерпании счётчика сектора first.
+    Перешифровываются только секторы, область out которых уже содержит шифртекст: секторы
+    с номерами меньше first и секторы, не отмеченные в шкале dirty. Остальные секторы будут
+    зашифрованы на новых ключах далее, поэтому у них только обнуляются счётчики; это важно
+    при зашифровании на месте, когда в них ещё находится открытый текст.
+    Для компактного представления счётчики раздела на время перешифрования выгружаются
+    во временный плоский массив.                                                                   */
+/* ----------------------------------------------------------------------------------------------- */
+static int ak_dec_re_encrypt_volume(ak_bckey bkey, ak_pointer out, ak_uint64 s, ak_uint64 v, ak_uint64 l,
+                                    ak_pointer l_j, ak_dec_counter_view ctrs, ak_uint64 j, ak_uint64 first,
+                                    const ak_uint8 *dirty) {
+    int error = ak_error_ok;
+    size_t csize = bkey->bsize / 2;
+    ak_uint8 *volume = (ak_uint8 *)out + j * s * l;
+    ak_uint8 *counters = NULL;
+
+    if(ctrs->compact == NULL) {
+        return ak_dec_re_encrypt_sectors(bkey, volume, volume, s, v, l, (ak_uint8 *)l_j + j * csize,
+                                         (ak_uint8 *)ctrs->flat + j * s * csize, j, first, dirty);
+    }
+
+    if((counters = malloc(s * csize)) == NULL) {
+        return ak_error_message(ak_error_out_of_memory, __func__, "incorrect memory allocation for counters");
+    }
+    for(ak_uint64 i = 0; i < s; ++i) {
+        ak_dec_counter_set(bkey->bsize, counters, i, ak_dec_view_get(ctrs, j * s + i));
+    }
+    if((error = ak_dec_re_encrypt_sectors(bkey, volume, volume, s, v, l, (ak_uint8 *)l_j + j * csize,
+                                          counters, j, first, dirty)) == ak_error_ok) {
+        for(ak_uint64 i = 0; i < s; ++i) {
+            if((error = ak_dec_view_set(ctrs, j * s + i, ak_dec_counter_get(bkey->bsize, counters, i))) != ak_error_ok) {
+                break;
+            }
+        }
+        for(ak_uint64 b = j * s / ak_dec_counters_block_size; b <= ((j + 1) * s - 1) / ak_dec_counters_block_size; ++b) {
+            ak_dec_counters_shrink_block(ctrs->compact, b);
+        }
+    }
+    free(counters);
+
+    return error;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция реализует общий для зашифрования и расшифрования проход по секторам раздела j.
+    Ключ раздела вырабатывается один раз для всех секторов раздела. При зашифровании перед
+    обработкой сектора его счётчик увеличивается; если счётчик исчерпан, то раздел перешифровывается
+    с помощью функции \ref ak_bckey_re_encrypt_dec().
+
+    Функция изменяет только данные и счётчики раздела j, поэтому различные разделы могут
+    обрабатываться одновременно в разных потоках (при использовании плоского массива счётчиков).
+    Если задана битовая шкала dirty, обрабатываются только секторы, отмеченные в ней единичным
+    битом (бит с номером j*s+i); остальные секторы и их счётчики не изменяются.
+    Счётчики разделов l_j всегда передаются плоским массивом, счётчики секторов -- через ctrs.
+    Рабочая область ws предоставляется вызывающей функцией и может использоваться для обработки
+    нескольких разделов подряд. Параметры функции предполагаются проверенными функцией
+    ak_dec_check_parameters().                                                                     */
+/* ----------------------------------------------------------------------------------------------- */
+static int ak_dec_workspace_process_volume(ak_dec_workspace ws, ak_bckey bkey, ak_pointer in, ak_pointer out,
+                                           ak_uint64 s, ak_uint64 v, ak_uint64 l, ak_pointer l_j,
+                                           ak_dec_counter_view ctrs, ak_dec_key_cache cache,
+                                           const ak_uint8 *dirty, ak_uint64 j, bool_t encrypt) {
+    int error = ak_error_ok;
+    ak_uint64 q = l / bkey->bsize;
+    ak_uint64 words = l / sizeof(ak_uint64);
+    ak_uint64 *inptr = (ak_uint64 *)in + j * s * words;
+    ak_uint64 *outptr = (ak_uint64 *)out + j * s * words;
+    ak_uint64 ctr = 0;
+
+    if((error = ak_dec_workspace_volume_key(ws, cache, bkey, j, ak_dec_counter_get(bkey->bsize, l_j, j))) != ak_error_ok) {
+        return error;
+    }
+
+    for(ak_uint64 i = 0; i < s; ++i, inptr += words, outptr += words) {
+        if((dirty != NULL) && !ak_dec_dirty_bit(dirty, j * s + i)) continue;
+        ctr = ak_dec_view_get(ctrs, j * s + i);
+
+        if(encrypt) {
+            if(ctr == ak_dec_counter_max(bkey->bsize)) {
+                if((error = ak_dec_re_encrypt_volume(bkey, out, s, v, l, l_j, ctrs, j, i, dirty)) != ak_error_ok) {
+                    return ak_error_message(error, __func__, "incorrect re-encryption of volume");
+                }
+                if((error = ak_dec_workspace_volume_key(ws, cache, bkey, j,
+                                                ak_dec_counter_get(bkey->bsize, l_j, j))) != ak_error_ok) {
+                    return error;
+                }
+                ctr = ak_dec_view_get(ctrs, j * s + i);
+            }
+            if((error = ak_dec_view_set(ctrs, j * s + i, ++ctr)) != ak_error_ok) {
+                return error;
+            }
+
+            if((cache != NULL) && (ctr / v != (ctr - 1) / v)) {
+                ak_dec_key_cache_retire_sector(cache, j, i, ak_dec_counter_get(bkey->bsize, l_j, j), (ctr - 1) / v);
+            }
+        }
+
+        if((error = ak_dec_sector_key(ws, cache, bkey->bsize, ws->k_j, j, ak_dec_counter_get(bkey->bsize, l_j, j),
+                                      i, ctr / v, ws->k_j_i)) != ak_error_ok) {
+            return error;
+        }
+        if((error = ak_dec_xor_sector(ws, bkey->bsize, ws->k_j_i, i, ctr * q, q, inptr, outptr)) != ak_error_ok) {
+            return error;
+        }
+    }
+
+    return error;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция обрабатывает раздел j, размещая для этого собственную рабочую область.
+    Если задана битовая шкала dirty и в разделе нет отмеченных секторов, раздел пропускается
+    без выработки ключей.                                                                          */
+/* ----------------------------------------------------------------------------------------------- */
+static int ak_dec_process_volume(ak_bckey bkey, ak_pointer in, ak_pointer out, ak_uint64 s,
+                                 ak_uint64 v, ak_uint64 l, ak_pointer l_j, ak_dec_counter_view ctrs,
+                                 ak_dec_key_cache cache, const ak_uint8 *dirty, ak_uint64 j, bool_t encrypt) {
+    int error = ak_error_ok;
+    struct dec_workspace local;
+    ak_dec_workspace ws = NULL;
+    ak_dec_arena arena = NULL;
+    size_t mark = 0;
+    ak_uint64 idx = 0;
+
+    if(dirty != NULL) {
+        for(idx = j * s; idx < (j + 1) * s; ++idx) {
+            if(ak_dec_dirty_bit(dirty, idx)) break;
+        }
+        if(idx == (j + 1) * s) return ak_error_ok;
+    }
+
+    if((ws = ak_dec_workspace_acquire(&local, &arena, &mark)) == NULL) return ak_error_out_of_memory;
+    error = ak_dec_workspace_process_volume(ws, bkey, in, out, s, v, l, l_j, ctrs, cache, dirty, j, encrypt);
+    ak_dec_workspace_release(ws, arena, mark);
+
+    return error;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция последовательно обрабатывает все разделы.                                             */
+/* ----------------------------------------------------------------------------------------------- */
+static int ak_dec_process(ak_bckey bkey, ak_pointer in, ak_pointer out, ak_uint64 w, ak_uint64 s, ak_uint64 v,
+                          ak_uint64 l, ak_pointer l_j, ak_dec_counter_view ctrs, bool_t encrypt) {
+    int error = ak_error_ok;
+    ak_dec_key_cache cache = ak_dec_key_cache_find(bkey);
+
+    for(ak_uint64 j = 0; j < w; ++j) {
+        if((error = ak_dec_process_volume(bkey, in, out, s, v, l, l_j, ctrs, cache, NULL, j,
+                                          encrypt)) != ak_error_ok) {
+            break;
+        }
+    }
+
+    return error;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*                  пул потоков, обрабатывающих разделы с учётом узлов NUMA                        */
+/* ----------------------------------------------------------------------------------------------- */
+/*! Узел NUMA: множество его процессоров и очередь закреплённых за ним разделов [next, last). */
+typedef struct dec_pool_node {
+ #ifdef AK_DEC_NUMA_AFFINITY
+    /*! Процессоры узла */
+    cpu_set_t cpus;
+ #endif
+    /*! Номер следующего необработанного раздела (изменяется атомарно) */
+    ak_uint64 next;
+    /*! Номер раздела, следующего за последним закреплённым за узлом */
+    ak_uint64 last;
+} *ak_dec_pool_node;
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Пул потоков, обрабатывающих разделы. Обработка одного раздела выполняется функцией task. */
+/* ----------------------------------------------------------------------------------------------- */
+typedef struct dec_pool {
+    /*! Функция обработки раздела j */
+    int (*task)(struct dec_pool *, ak_uint64 );
+    /*! Контекст ключа алгоритма блочного шифрования */
+    ak_bckey bkey;
+    /*! Входные данные */
+    ak_pointer in;
+    /*! Выходные данные */
+    ak_pointer out;
+    /*! Параметры режима */
+    ak_uint64 w, s, v, l;
+    /*! Счётчики разделов */
+    ak_pointer l_j;
+    /*! Счётчики секторов */
+    struct dec_counter_view ctrs;
+    /*! Кэш производных ключей */
+    ak_dec_key_cache cache;
+    /*! Признак зашифрования */
+    bool_t encrypt;
+    /*! Дополнительные параметры функции task */
+    ak_pointer arg;
+    /*! Количество узлов NUMA */
+    size_t nodes;
+    /*! Узлы NUMA */
+    struct dec_pool_node node[ak_dec_max_numa_nodes];
+    /*! Код первой возникшей ошибки */
+    int error;
+} *ak_dec_pool;
+
+#ifdef AK_DEC_THREADS
+/* ----------------------------------------------------------------------------------------------- */
+/*! Поток пула, закреплённый за узлом node. */
+typedef struct dec_pool_worker {
+    /*! Пул */
+    ak_dec_pool pool;
+    /*! Номер узла, за которым закреплён поток */
+    size_t node;
+    /*! Идентификатор потока */
+    pthread_t thread;
+} *ak_dec_pool_worker;
+#endif
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция обработки раздела для функций зашифрования и расшифрования.                           */
+/* ----------------------------------------------------------------------------------------------- */
+static int ak_dec_pool_process_volume(ak_dec_pool pool, ak_uint64 j) {
+    return ak_dec_process_volume(pool->bkey, pool->in, pool->out, pool->s, pool->v, pool->l,
+                                 pool->l_j, &pool->ctrs, pool->cache, NULL, j, pool->encrypt);
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция определяет узлы NUMA и множества их процессоров по данным /sys/devices/system/node.
+    Если сведения о топологии недоступны, используется один узел, включающий все процессоры.    */
+/* ----------------------------------------------------------------------------------------------- */
+static void ak_dec_pool_detect_nodes(ak_dec_pool pool) {
+#ifdef AK_DEC_NUMA_AFFINITY
+    char path[64];
+    FILE *fp = NULL;
+    int first = 0, last = 0;
+    char sep = 0;
+
+    pool->nodes = 0;
+    for(size_t n = 0; n < ak_dec_max_numa_nodes; ++n) {
+        ak_dec_pool_node node = pool->node + pool->nodes;
+
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", (unsigned int)n);
+        if((fp = fopen(path, "r")) == NULL) continue;
+
+        CPU_ZERO(&node->cpus);
+        while(fscanf(fp, "%d", &first) == 1) {
+            last = first;
+            if((sep = (char)fgetc(fp)) == '-') {
+                if(fscanf(fp, "%d", &last) != 1) break;
+                sep = (char)fgetc(fp);
+            }
+            for(int cpu = first; (cpu <= last) && (cpu < CPU_SETSIZE); ++cpu) CPU_SET(cpu, &node->cpus);
+            if(sep != ',') break;
+        }
+        fclose(fp);
+        if(CPU_COUNT(&node->cpus) > 0) pool->nodes++;
+    }
+    if(pool->nodes > 0) return;
+
+    CPU_ZERO(&pool->node[0].cpus);
+    if(sched_getaffinity(0, sizeof(cpu_set_t), &pool->node[0].cpus) != 0) {
+        for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu) CPU_SET(cpu, &pool->node[0].cpus);
+    }
+#endif
+    pool->nodes = 1;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция выбирает очередной раздел и обрабатывает его. Сначала выбираются разделы узла,
+    за которым закреплён поток, затем -- разделы остальных узлов в порядке возрастания номера
+    (перехват работы). Обработка прекращается после первой ошибки в любом из потоков.             */
+/* ----------------------------------------------------------------------------------------------- */
+static void ak_dec_pool_drain(ak_dec_pool pool, size_t home) {
+    int error = ak_error_ok, expected = ak_error_ok;
+
+    for(size_t k = 0; k < pool->nodes; ++k) {
+        ak_dec_pool_node node = pool->node + (home + k) % pool->nodes;
+
+        while(ak_dec_atomic_load(&pool->error, RELAXED) == ak_error_ok) {
+            ak_uint64 j = ak_dec_atomic_fetch_add(&node->next, 1);
+
+            if(j >= node->last) break;
+            if((error = pool->task(pool, j)) != ak_error_ok) {
+                expected = ak_error_ok;
+                ak_dec_atomic_cas(&pool->error, &expected, error, RELAXED);
+            }
+        }
+    }
+}
+
+#ifdef AK_DEC_THREADS
+/* ----------------------------------------------------------------------------------------------- */
+/*! Поток закрепляется на процессорах своего узла до выделения каких-либо ресурсов, поэтому
+    развёрнутые ключи и буферы гаммы, размещаемые в стеке или в защищённой области потока,
+    оказываются в памяти узла.                                                                    */
+/* ----------------------------------------------------------------------------------------------- */
+static void *ak_dec_pool_thread(void *arg) {
+    ak_dec_pool_worker worker = (ak_dec_pool_worker)arg;
+
+ #ifdef AK_DEC_NUMA_AFFINITY
+    if(worker->pool->nodes > 1) {
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &worker->pool->node[worker->node].cpus);
+    }
+ #endif
+    ak_dec_pool_drain(worker->pool, worker->node);
+    return NULL;
+}
+#endif
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция распределяет разделы между узлами NUMA непрерывными диапазонами, создаёт threads
+    потоков (потоки распределяются по узлам поочерёдно) и ожидает их завершения.
+    Если threads равно нулю, используется количество доступных процессоров.
+
+    Потоки создаются при каждом вызове функции и завершаются до возврата из неё; постоянных
+    потоков, ожидающих работы между вызовами, библиотека не содержит. Поэтому каждый вызов
+    дополнительно затрачивает время на создание и ожидание потоков (десятки микросекунд
+    на поток), и многопоточная обработка оправдана лишь для разделов достаточно большого объёма.
+
+    @return Функция возвращает код первой возникшей ошибки либо \ref ak_error_ok (ноль).          */
+/* ----------------------------------------------------------------------------------------------- */
+static int ak_dec_pool_spawn(ak_dec_pool pool, size_t threads) {
+#ifdef AK_DEC_THREADS
+    ak_dec_pool_worker workers = NULL;
+    size_t started = 0;
+#endif
+
+    ak_dec_pool_detect_nodes(pool);
+    if(pool->nodes > pool->w) pool->nodes = (size_t)pool->w;
+    for(size_t n = 0; n < pool->nodes; ++n) {
+        pool->node[n].next = pool->w * n / pool->nodes;
+        pool->node[n].last = pool->w * (n + 1) / pool->nodes;
+    }
+    pool->error = ak_error_ok;
+
+#ifdef AK_DEC_THREADS
+ #ifdef LIBAKRYPT_HAVE_UNISTD_H
+    if(threads == 0) threads = (size_t)sysconf(_SC_NPROCESSORS_ONLN);
+ #endif
+    if(threads > pool->w) threads = (size_t)pool->w;
+
+    if((threads > 1) && ((workers = malloc(threads * sizeof(struct dec_pool_worker))) != NULL)) {
+        for(size_t t = 0; t < threads; ++t) {
+            workers[t].pool = pool;
+            workers[t].node = t % pool->nodes;
+            if(pthread_create(&workers[t].thread, NULL, ak_dec_pool_thread, workers + t) != 0) break;
+            started++;
+        }
+        for(size_t t = 0; t < started; ++t) pthread_join(workers[t].thread, NULL);
+        free(workers);
+    }
+#else
+    (void)threads;
+#endif
+    /* оставшиеся разделы (если потоки не создавались) обрабатываются в вызывающем потоке */
+    ak_dec_pool_drain(pool, 0);
+
+    return pool->error;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+static int ak_dec_process_parallel(ak_bckey bkey, ak_pointer in, ak_pointer out, size_t size, ak_uint64 w,
+                                   ak_uint64 s, ak_uint64 v, ak_uint64 l, ak_pointer l_j, ak_pointer l_j_i,
+                                   size_t threads, bool_t encrypt) {
+    int error = ak_error_ok;
+    struct dec_pool pool;
+
+    if((error = ak_dec_check_parameters(bkey, in, out, size, w, s, v, l, l_j, l_j_i)) != ak_error_ok) {
+        return ak_error_message(error, __func__, "incorrect parameters of dec mode");
+    }
+
+    memset(&pool, 0, sizeof(struct dec_pool));
+    pool.task = ak_dec_pool_process_volume;
+    pool.bkey = bkey;
+    pool.in = in;
+    pool.out = out;
+    pool.w = w;
+    pool.s = s;
+    pool.v = v;
+    pool.l = l;
+    pool.l_j = l_j;
+    pool.ctrs.bsize = bkey->bsize;
+    pool.ctrs.flat = l_j_i;
+    pool.cache = ak_dec_key_cache_find(bkey);
+    pool.encrypt = encrypt;
+
+    return ak_dec_pool_spawn(&pool, threads);
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция обрабатывает массив заданий: сначала проверяются параметры всех заданий,
+    затем корректные задания выполняются группами, объединяющими задания с одним контекстом
+    ключа bkey (группы -- в порядке первого вхождения ключа, задания группы -- в порядке
+    следования в массиве). Все задания обрабатываются в одной рабочей области, поэтому контекст
+    ключа сектора создаётся один раз, а ключ раздела, выработанный для одного задания группы,
+    используется повторно в следующих заданиях с тем же номером раздела и значением его
+    счётчика. Кэш производных ключей ищется один раз для каждой группы.                          */
+/* ----------------------------------------------------------------------------------------------- */
+static int ak_dec_process_batch(ak_dec_job jobs, size_t count, bool_t encrypt) {
+    int error = ak_error_ok;
+    struct dec_workspace local;
+    ak_dec_workspace ws = NULL;
+    ak_dec_arena arena = NULL;
+    size_t mark = 0;
+
+    if(jobs == NULL) {
+        return ak_error_message(ak_error_null_pointer, __func__, "using null pointer to array of jobs");
+    }
+
+    for(size_t n = 0; n < count; ++n) {
+        jobs[n].error = ak_dec_check_parameters(jobs[n].bkey, jobs[n].in, jobs[n].out, jobs[n].size, jobs[n].w,
+                                                jobs[n].s, jobs[n].v, jobs[n].l, jobs[n].l_j, jobs[n].l_j_i);
+    }
+
+    if((ws = ak_dec_workspace_acquire(&local, &arena, &mark)) == NULL) {
+        for(size_t n = 0; n < count; ++n) {
+            if(jobs[n].error == ak_error_ok) jobs[n].error = ak_error_out_of_memory;
+        }
+    }
+    for(size_t n = 0; (ws != NULL) && (n < count); ++n) {
+        ak_bckey bkey = jobs[n].bkey;
+        ak_dec_key_cache cache = NULL;
+        size_t first = 0;
+
+        /* группа задания n уже обработана, если ключ встречался ранее */
+        while(jobs[first].bkey != bkey) ++first;
+        if((first < n) || (bkey == NULL)) continue;
+
+        cache = ak_dec_key_cache_find(bkey);
+        for(size_t m = n; m < count; ++m) {
+            ak_dec_job job = jobs + m;
+            if((job->bkey != bkey) || (job->error != ak_error_ok)) continue;
+
+            struct dec_counter_view ctrs = { bkey->bsize, job->l_j_i, NULL };
+
+            for(ak_uint64 j = 0; j < job->w; ++j) {
+                if((job->error = ak_dec_workspace_process_volume(ws, bkey, job->in, job->out, job->s, job->v,
+                                        job->l, job->l_j, &ctrs, cache, NULL, j, encrypt)) != ak_error_ok) {
+                    break;
+                }
+            }
+        }
+    }
+    if(ws != NULL) ak_dec_workspace_release(ws, arena, mark);
+
+    for(size_t n = 0; n < count; ++n) {
+        if((error = jobs[n].error) != ak_error_ok) break;
+    }
+    return error;
+}
+
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! При вычислении шифртекста сообщения в режиме `DEC` каждый массив данных разбивают на разделы,
+	которые в свою очередь разбиваются на секторы, состоящие из q блоков.
+
+
+    Длины раздела и сектора является параметром алгоритма и должна удовлетворять требованиям, определёнынм
+	в соответствующих рекомендациях по стандартизации.
+
+
+	При шифровании из входных параметров формируются производные из входного ключа ключи разделов,
+	из которых реализуются производные ключи для секторов. Сектор делится на q блоков, которыми оперирует 
+	блочный шифр, и шифруется на данном ключе сектора.
+
+    @param bkey Контекст ключа алгоритма блочного шифрования,
+    используемый для шифрования и порождения цепочки производных ключей.
+    @param in Указатель на область памяти, где хранятся входные данные.
+    @param out Указатель на область памяти, куда помещаются выходные данные.
+    @param size Размер данных (в байтах), для которых вычисляется имитовставка. 
+    @param w Количество разделов, на которые делятся входные данные
+    @param s Количество секторов в разделе
+	@param v Частота смены ключа
+    @param l Длина сектора в байтах
+	@param l_j Указатель на область памяти, в которой хранятся счётчики для разделов
+	@param l_j_i Указатель на область памяти, в которой хранятся счётчики для секторов
+
+    @return В случае возникновения ошибки функция возвращает ее код, в противном случае
+    возвращается \ref ak_error_ok (ноль)                                                           */
+/* ----------------------------------------------------------------------------------------------- */
+int ak_bckey_encrypt_dec(ak_bckey bkey, ak_pointer in, ak_pointer out, size_t size, ak_uint64 w, ak_uint64 s, ak_uint64 v,
+                    ak_uint64 l, ak_pointer l_j, ak_pointer l_j_i) {
+    int error = ak_error_ok;
+    struct dec_counter_view ctrs = { 0, NULL, NULL };
+
+    if((error = ak_dec_check_parameters(bkey, in, out, size, w, s, v, l, l_j, l_j_i)) != ak_error_ok) {
+        return ak_error_message(error, __func__, "incorrect parameters of dec mode");
+    }
+
+    ctrs.bsize = bkey->bsize;
+    ctrs.flat = l_j_i;
+    return ak_dec_process(bkey, in, out, w, s, v, l, l_j, &ctrs, ak_true);
+}
+
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! При вычислении открытого текста сообщения в режиме `DEC` каждый массив данных разбивают на разделы,
+	которые в свою очередь разбиваются на секторы, состоящие из q блоков.
+
+
+    Длины раздела и сектора является параметром алгоритма и должна удовлетворять требованиям, определёнынм
+	в соответствующих рекомендациях по стандартизации.
+
+
+	При расшифровании из входных параметров формируются производные из входного ключа ключи разделов,
+	из которых реализуются производные ключи для секторов. Сектор делится на q блоков, которыми оперирует 
+	блочный шифр, и расшифровывается на данном ключе сектора.
+
+    @param bkey Контекст ключа алгоритма блочного шифрования,
+    используемый для шифрования и порождения цепочки производных ключей.
+    @param in Указатель на область памяти, где хранятся входные данные.
+    @param out Указатель на область памяти, куда помещаются выходные данные.
+    @param size Размер данных (в байтах), для которых вычисляется имитовставка. 
+    @param w Количество разделов, на которые делятся входные данные
+    @param s Количество секторов в разделе
+	@param v Частота смены ключа
+    @param l Длина сектора в байтах
+	@param l_j Указатель на область памяти, в которой хранятся счётчики для разделов
+	@param l_j_i Указатель на область памяти, в которой хранятся счётчики для секторов
+
+    @return В случае возникновения ошибки функция возвращает ее код, в противном случае
+    возвращается \ref ak_error_ok (ноль)                                                           */
+/* ----------------------------------------------------------------------------------------------- */
+int ak_bckey_decrypt_dec(ak_bckey bkey, ak_pointer in, ak_pointer out, size_t size, ak_uint64 w, ak_uint64 s, ak_uint64 v,
+                    ak_uint64 l, ak_pointer l_j, ak_pointer l_j_i) {
+    int error = ak_error_ok;
+    struct dec_counter_view ctrs = { 0, NULL, NULL };
+
+    if((error = ak_dec_check_parameters(bkey, in, out, size, w, s, v, l, l_j, l_j_i)) != ak_error_ok) {
+        return ak_error_message(error, __func__, "incorrect parameters of dec mode");
+    }
+
+    ctrs.bsize = bkey->bsize;
+    ctrs.flat = l_j_i;
+    return ak_dec_process(bkey, in, out, w, s, v, l, l_j, &ctrs, ak_false);
+}
+
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция зашифровывает в режиме `DEC` набор независимых массивов данных, каждый из которых
+    может обрабатываться на собственном ключе и со своими счётчиками (например, данные разных
+    владельцев). Параметры всех заданий проверяются заранее. Задания с одним контекстом ключа
+    выполняются подряд в общей рабочей области: ключ раздела, выработанный для одного задания,
+    повторно используется другими заданиями на том же ключе с тем же номером раздела и значением
+    его счётчика, а контекст ключа сектора создаётся один раз для всего набора. Выигрыш
+    по сравнению с последовательностью вызовов \ref ak_bckey_encrypt_dec() тем больше, чем
+    больше в наборе заданий на одном ключе и чем меньше в них секторов.
+
+    Ошибка в одном задании не прерывает обработку остальных; код ошибки каждого задания
+    помещается в поле `error` соответствующего элемента массива.
+
+    @param jobs Указатель на массив заданий.
+    @param count Количество заданий в массиве.
+
+    @return Функция возвращает код ошибки первого (в порядке следования в массиве) задания,
+    завершившегося с ошибкой, либо \ref ak_error_ok (ноль), если все задания выполнены успешно.    */
+/* ----------------------------------------------------------------------------------------------- */
+int ak_bckey_encrypt_dec_batch(ak_dec_job jobs, size_t count) {
+    return ak_dec_process_batch(jobs, count, ak_true);
+}
+
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция расшифровывает в режиме `DEC` набор независимых массивов данных.
+    Порядок обработки и смысл возвращаемого значения совпадают с функцией
+    \ref ak_bckey_encrypt_dec_batch().
+
+    @param jobs Указатель на массив заданий.
+    @param count Количество заданий в массиве.
+
+    @return Функция возвращает код ошибки первого (в порядке следования в массиве) задания,
+    завершившегося с ошибкой, либо \ref ak_error_ok (ноль), если все задания выполнены успешно.    */
+/* ----------------------------------------------------------------------------------------------- */
+int ak_bckey_decrypt_dec_batch(ak_dec_job jobs, size_t count) {
+    return ak_dec_process_batch(jobs, count, ak_false);
+}
+
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция проверяет соответствие компактного представления счётчиков параметрам режима
+    и выполняет общий проход по разделам.                                                          */
+/* ----------------------------------------------------------------------------------------------- */
+static int ak_dec_process_counters(ak_bckey bkey, ak_pointer in, ak_pointer out, size_t size, ak_uint64 w,
+                                   ak_uint64 s, ak_uint64 v, ak_uint64 l, ak_pointer l_j, ak_dec_counters l_j_i,
+                                   bool_t encrypt) {
+    int error = ak_error_ok;
+    struct dec_counter_view ctrs = { 0, NULL, l_j_i };
+
+    if((error = ak_dec_check_parameters(bkey, in, out, size, w, s, v, l, l_j, l_j_i)) != ak_error_ok) {
+        return ak_error_message(error, __func__, "incorrect parameters of dec mode");
+    }
+    if((l_j_i->bsize != bkey->bsize) || (l_j_i->w != w) || (l_j_i->s != s)) {
+        return ak_error_message(ak_error_wrong_length, __func__, "counters context does not match dec parameters");
+    }
+
+    ctrs.bsize = bkey->bsize;
+    return ak_dec_process(bkey, in, out, w, s, v, l, l_j, &ctrs, encrypt);
+}
 
 
 /* ----------------------------------------------------------------------------------------------- */
-/*! При вычислении шифртекста сообщения в режиме `DEC` каждый массив данных разбивают на разделы,
-	которые в свою очередь разбиваются на секторы, состоящие из q блоков.
+/*! Функция зашифровывает данные в режиме `DEC` так же, как и функция \ref ak_bckey_encrypt_dec(),
+    однако счётчики секторов хранятся в компактном представлении, созданном функцией
+    \ref ak_dec_counters_create(). Значения счётчиков и результат зашифрования совпадают
+    с получаемыми при использовании плоского массива счётчиков.
 
+    @param bkey Контекст ключа алгоритма блочного шифрования.
+    @param in Указатель на область памяти, где хранятся входные данные.
+    @param out Указатель на область памяти, куда помещаются выходные данные.
+    @param size Размер данных (в байтах).
+    @param w Количество разделов, на которые делятся входные данные
+    @param s Количество секторов в разделе
+    @param v Частота смены ключа
+    @param l Длина сектора в байтах
+    @param l_j Указатель на область памяти, в которой хранятся счётчики для разделов
+    @param l_j_i Контекст компактного представления счётчиков для секторов
 
-    Длины раздела и сектора является параметром алгоритма и должна удовлетворять требованиям, определёнынм
-	в соответствующих рекомендациях по стандартизации.
+    @return В случае возникновения ошибки функция возвращает ее код, в противном случае
+    возвращается \ref ak_error_ok (ноль)                                                           */
+/* ----------------------------------------------------------------------------------------------- */
+int ak_bckey_encrypt_dec_counters(ak_bckey bkey, ak_pointer in, ak_pointer out, size_t size, ak_uint64 w,
+                                  ak_uint64 s, ak_uint64 v, ak_uint64 l, ak_pointer l_j, ak_dec_counters l_j_i) {
+    return ak_dec_process_counters(bkey, in, out, size, w, s, v, l, l_j, l_j_i, ak_true);
+}
 
 
-	При шифровании из входных параметров формируются производные из входного ключа ключи разделов,
-	из которых реализуются производные ключи для секторов. Сектор делится на q блоков, которыми оперирует 
-	блочный шифр, и шифруется на данном ключе сектора.
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция расшифровывает данные в режиме `DEC` так же, как и функция \ref ak_bckey_decrypt_dec(),
+    используя компактное представление счётчиков секторов.
 
-    @param bkey Контекст ключа алгоритма блочного шифрования,
-    используемый для шифрования и порождения цепочки производных ключей.
+    @param bkey Контекст ключа алгоритма блочного шифрования.
     @param in Указатель на область памяти, где хранятся входные данные.
     @param out Указатель на область памяти, куда помещаются выходные данные.
-    @param size Размер данных (в байтах), для которых вычисляется имитовставка. 
+    @param size Размер данных (в байтах).
     @param w Количество разделов, на которые делятся входные данные
     @param s Количество секторов в разделе
-	@param v Частота смены ключа
+    @param v Частота смены ключа
     @param l Длина сектора в байтах
-	@param l_j Указатель на область памяти, в которой хранятся счётчики для разделов
-	@param l_j_i Указатель на область памяти, в которой хранятся счётчики для секторов
+    @param l_j Указатель на область памяти, в которой хранятся счётчики для разделов
+    @param l_j_i Контекст компактного представления счётчиков для секторов
 
     @return В случае возникновения ошибки функция возвращает ее код, в противном случае
     возвращается \ref ak_error_ok (ноль)                                                           */
 /* ----------------------------------------------------------------------------------------------- */
-int ak_bckey_encrypt_dec(ak_bckey bkey, ak_pointer in, ak_pointer out, size_t size, ak_uint64 w, ak_uint64 s, ak_uint64 v,
-                    ak_uint64 l, ak_pointer l_j, ak_pointer l_j_i) {
-    int error = ak_error_ok;
-    ak_uint64 *inptr = (ak_uint64 *)in;
-    ak_uint64 *outptr = (ak_uint64 *)out;
-    ak_uint64 q = l / bkey->bsize;
-    struct kdf_state ks;
-    struct bckey internalContext;
-    ak_uint8 seed[32] = {0};
-    ak_uint8 k_j[32] = {0};
-    ak_uint8 k_j_i[32] = {0};
-    ak_uint64 delta[2] = {0};
-    ak_uint128 z0;
-    ak_uint128 P;
-    ak_uint128 CTR;
-    ak_uint32 *l_j_i_ptr_8 = (ak_uint32 *)l_j_i;
-    ak_uint32 *l_j_ptr_8 = (ak_uint32 *)l_j;
-    ak_uint64 *l_j_i_ptr_16 = (ak_uint64 *)l_j_i;
-    ak_uint64 *l_j_ptr_16 = (ak_uint64 *)l_j;
+int ak_bckey_decrypt_dec_counters(ak_bckey bkey, ak_pointer in, ak_pointer out, size_t size, ak_uint64 w,
+                                  ak_uint64 s, ak_uint64 v, ak_uint64 l, ak_pointer l_j, ak_dec_counters l_j_i) {
+    return ak_dec_process_counters(bkey, in, out, size, w, s, v, l, l_j, l_j_i, ak_false);
+}
 
-    if((bkey->bsize != 8) &&  (bkey->bsize != 16)) {
-        error = ak_error_wrong_block_cipher;
-        ak_error_message(error, __func__ , "incorrect block size of block cipher key");
-        goto ext;
-    }
 
-    if(l_j == NULL) {
-        error = ak_error_null_pointer;
-        ak_error_message(error, __func__, "incorrect pointer to l_j");
-        goto ext;
-    }
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция зашифровывает данные в режиме `DEC` так же, как и функция \ref ak_bckey_encrypt_dec(),
+    распределяя разделы между несколькими потоками. Разделы закрепляются за узлами NUMA
+    непрерывными диапазонами, потоки закрепляются на процессорах своих узлов, а развёрнутые ключи
+    и буферы гаммы размещаются в памяти узла, на котором выполняется поток. Поток, обработавший
+    разделы своего узла, забирает необработанные разделы других узлов.
 
-    if(l_j_i == NULL) {
-        error = ak_error_null_pointer;
-        ak_error_message(error, __func__, "incorrect pointer to l_j_i");
-        goto ext;
-    }
+    Для наилучшего результата области in и out следует заполнять (первое обращение к страницам)
+    потоками того узла, за которым закреплены соответствующие разделы.
 
-    if(in == NULL) {
-        error = ak_error_null_pointer;
-        ak_error_message(error, __func__, "incorrect pointer to plain text");
-        goto ext;
-    }
+    Потоки создаются при каждом вызове функции и завершаются до возврата из неё, поэтому
+    для небольших объёмов данных последовательная функция \ref ak_bckey_encrypt_dec()
+    может оказаться быстрее.
 
-    if(out == NULL) {
-        error = ak_error_null_pointer;
-        ak_error_message(error, __func__, "incorrect pointer to cipher text");
-        goto ext;
-    }
+    @param bkey Контекст ключа алгоритма блочного шифрования.
+    @param in Указатель на область памяти, где хранятся входные данные.
+    @param out Указатель на область памяти, куда помещаются выходные данные.
+    @param size Размер данных (в байтах).
+    @param w Количество разделов, на которые делятся входные данные
+    @param s Количество секторов в разделе
+    @param v Частота смены ключа
+    @param l Длина сектора в байтах
+    @param l_j Указатель на область памяти, в которой хранятся счётчики для разделов
+    @param l_j_i Указатель на область памяти, в которой хранятся счётчики для секторов
+    @param threads Количество потоков; если значение равно нулю, используется количество
+    доступных процессоров.
 
-    if(l % bkey->bsize != 0) {
-        error = ak_error_wrong_length;
-        ak_error_message(error, __func__, "incorrect sector byte size");
-        goto ext;
-    }
+    @return В случае возникновения ошибки функция возвращает ее код, в противном случае
+    возвращается \ref ak_error_ok (ноль)                                                           */
+/* ----------------------------------------------------------------------------------------------- */
+int ak_bckey_encrypt_dec_parallel(ak_bckey bkey, ak_pointer in, ak_pointer out, size_t size, ak_uint64 w,
+                                  ak_uint64 s, ak_uint64 v, ak_uint64 l, ak_pointer l_j, ak_pointer l_j_i,
+                                  size_t threads) {
+    return ak_dec_process_parallel(bkey, in, out, size, w, s, v, l, l_j, l_j_i, threads, ak_true);
+}
 
-    if((ak_uint64)(2 << (bkey->bsize / 2)) % q != 0) {
-        error = ak_error_wrong_length;
-        ak_error_message(error, __func__, "incorrect number of blocks in a sector");
-        goto ext;
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция расшифровывает данные в режиме `DEC` так же, как и функция \ref ak_bckey_decrypt_dec(),
+    распределяя разделы между несколькими потоками по правилам функции
+    \ref ak_bckey_encrypt_dec_parallel().
+
+    @param bkey Контекст ключа алгоритма блочного шифрования.
+    @param in Указатель на область памяти, где хранятся входные данные.
+    @param out Указатель на область памяти, куда помещаются выходные данные.
+    @param size Размер данных (в байтах).
+    @param w Количество разделов, на которые делятся входные данные
+    @param s Количество секторов в разделе
+    @param v Частота смены ключа
+    @param l Длина сектора в байтах
+    @param l_j Указатель на область памяти, в которой хранятся счётчики для разделов
+    @param l_j_i Указатель на область памяти, в которой хранятся счётчики для секторов
+    @param threads Количество потоков; если значение равно нулю, используется количество
+    доступных процессоров.
+
+    @return В случае возникновения ошибки функция возвращает ее код, в противном случае
+    возвращается \ref ak_error_ok (ноль)                                                           */
+/* ----------------------------------------------------------------------------------------------- */
+int ak_bckey_decrypt_dec_parallel(ak_bckey bkey, ak_pointer in, ak_pointer out, size_t size, ak_uint64 w,
+                                  ak_uint64 s, ak_uint64 v, ak_uint64 l, ak_pointer l_j, ak_pointer l_j_i,
+                                  size_t threads) {
+    return ak_dec_process_parallel(bkey, in, out, size, w, s, v, l, l_j, l_j_i, threads, ak_false);
+}
+
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Состояние перешифрования разделов, общее для всех потоков пула.                               */
+/* ----------------------------------------------------------------------------------------------- */
+typedef struct dec_rekey_state {
+    /*! Ограничение скорости перешифрования (байт в секунду); ноль -- без ограничения */
+    ak_uint64 bandwidth;
+    /*! Момент времени (в наносекундах), начиная с которого разрешена обработка следующего раздела */
+    ak_uint64 clock;
+    /*! Количество перешифрованных разделов */
+    ak_uint64 done;
+    /*! Функция оповещения о ходе перешифрования */
+    ak_dec_progress_function *progress;
+    /*! Параметр функции оповещения */
+    ak_pointer arg;
+ #ifdef LIBAKRYPT_HAVE_PTHREAD_H
+    /*! Блокировка, защищающая поля clock, done и вызовы функции progress */
+    pthread_mutex_t lock;
+ #endif
+} *ak_dec_rekey_state;
+
+/* ----------------------------------------------------------------------------------------------- */
+static inline void ak_dec_rekey_lock(ak_dec_rekey_state state) {
+ #ifdef LIBAKRYPT_HAVE_PTHREAD_H
+    pthread_mutex_lock(&state->lock);
+ #else
+    (void)state;
+ #endif
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+static inline void ak_dec_rekey_unlock(ak_dec_rekey_state state) {
+ #ifdef LIBAKRYPT_HAVE_PTHREAD_H
+    pthread_mutex_unlock(&state->lock);
+ #else
+    (void)state;
+ #endif
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция приостанавливает поток так, чтобы суммарная скорость обработки данных всеми потоками
+    не превышала state->bandwidth байт в секунду. Каждый поток резервирует интервал времени,
+    пропорциональный объёму обрабатываемого раздела, и ожидает его начала.                        */
+/* ----------------------------------------------------------------------------------------------- */
+static void ak_dec_rekey_throttle(ak_dec_rekey_state state, ak_uint64 bytes) {
+#ifdef LIBAKRYPT_HAVE_TIME_H
+    struct timespec ts;
+    ak_uint64 now = 0, start = 0;
+
+    if(state->bandwidth == 0) return;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    now = (ak_uint64)ts.tv_sec * 1000000000LL + (ak_uint64)ts.tv_nsec;
+
+    ak_dec_rekey_lock(state);
+    start = (state->clock > now) ? state->clock : now;
+    state->clock = start + bytes * 1000000000LL / state->bandwidth;
+    ak_dec_rekey_unlock(state);
+
+    if(start > now) {
+        ts.tv_sec = (time_t)((start - now) / 1000000000LL);
+        ts.tv_nsec = (long)((start - now) % 1000000000LL);
+        nanosleep(&ts, NULL);
     }
+#else
+    (void)state;
+    (void)bytes;
+#endif
+}
 
-    if((ak_uint64)(2 << (bkey->bsize / 2)) % w != 0) {
-        error = ak_error_wrong_length;
-        ak_error_message(error, __func__, "incorrect number of volumes");
-        goto ext;
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция обработки раздела для функции \ref ak_bckey_re_encrypt_dec_volumes().                */
+/* ----------------------------------------------------------------------------------------------- */
+static int ak_dec_pool_re_encrypt_volume(ak_dec_pool pool, ak_uint64 j) {
+    int error = ak_error_ok;
+    ak_dec_rekey_state state = (ak_dec_rekey_state)pool->arg;
+    size_t csize = pool->bkey->bsize / 2;
+    ak_uint64 bytes = pool->s * pool->l;
+
+    ak_dec_rekey_throttle(state, bytes);
+    if((error = ak_bckey_re_encrypt_dec(pool->bkey, (ak_uint8 *)pool->in + j * bytes, (ak_uint8 *)pool->out + j * bytes,
+                                        bytes, pool->w, pool->s, pool->v, pool->l, (ak_uint8 *)pool->l_j + j * csize,
+                                        (ak_uint8 *)pool->ctrs.flat + j * pool->s * csize, j)) != ak_error_ok) {
+        return error;
     }
 
-    if((ak_uint64)(2 << (bkey->bsize / 2)) % s != 0) {
-        error = ak_error_wrong_length;
-        ak_error_message(error, __func__, "incorrect number of sectors in a volume");
-        goto ext;
+    ak_dec_rekey_lock(state);
+    state->done++;
+    if(state->progress != NULL) state->progress(state->done, pool->w, state->arg);
+    ak_dec_rekey_unlock(state);
+
+    return error;
+}
+
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция перешифровывает в режиме `DEC` все w разделов данных, то есть выполняет
+    для каждого раздела j действия функции \ref ak_bckey_re_encrypt_dec(): счётчик раздела l_j
+    увеличивается, счётчики секторов обнуляются, а данные перешифровываются на новых ключах.
+    Разделы обрабатываются одновременно несколькими потоками по правилам функции
+    \ref ak_bckey_encrypt_dec_parallel().
+
+    Чтобы перешифрование не мешало основной нагрузке, его можно ограничить по количеству
+    потоков (загрузке процессора) и по скорости обработки данных.
+
+    @param bkey Контекст ключа алгоритма блочного шифрования.
+    @param in Указатель на область памяти, где хранится шифртекст.
+    @param out Указатель на область памяти, куда помещается новый шифртекст (может совпадать с in).
+    @param size Размер данных (в байтах).
+    @param w Количество разделов, на которые делятся входные данные
+    @param s Количество секторов в разделе
+    @param v Частота смены ключа
+    @param l Длина сектора в байтах
+    @param l_j Указатель на область памяти, в которой хранятся счётчики для разделов
+    @param l_j_i Указатель на область памяти, в которой хранятся счётчики для секторов
+    @param threads Количество потоков; если значение равно нулю, используется количество
+    доступных процессоров.
+    @param bandwidth Ограничение суммарной скорости перешифрования в байтах в секунду;
+    ноль означает отсутствие ограничения.
+    @param progress Функция, вызываемая после перешифрования каждого раздела (может быть NULL).
+    Вызовы функции выполняются из потоков пула, но не пересекаются во времени.
+    @param arg Параметр, передаваемый функции progress.
+
+    @return В случае возникновения ошибки функция возвращает ее код, в противном случае
+    возвращается \ref ak_error_ok (ноль)                                                           */
+/* ----------------------------------------------------------------------------------------------- */
+int ak_bckey_re_encrypt_dec_volumes(ak_bckey bkey, ak_pointer in, ak_pointer out, size_t size, ak_uint64 w,
+                                    ak_uint64 s, ak_uint64 v, ak_uint64 l, ak_pointer l_j, ak_pointer l_j_i,
+                                    size_t threads, ak_uint64 bandwidth, ak_dec_progress_function *progress,
+                                    ak_pointer arg) {
+    int error = ak_error_ok;
+    struct dec_pool pool;
+    struct dec_rekey_state state;
+
+    if((error = ak_dec_check_parameters(bkey, in, out, size, w, s, v, l, l_j, l_j_i)) != ak_error_ok) {
+        return ak_error_message(error, __func__, "incorrect parameters of dec mode");
     }
 
-    if(((ak_uint64)2 << (bkey->bsize / 2)) < v * q) {
-        error = ak_error_wrong_length;
-        ak_error_message(error, __func__, "incorrect frequency of changing key_in");
-        goto ext;
+    memset(&state, 0, sizeof(struct dec_rekey_state));
+    state.bandwidth = bandwidth;
+    state.progress = progress;
+    state.arg = arg;
+ #ifdef LIBAKRYPT_HAVE_PTHREAD_H
+    pthread_mutex_init(&state.lock, NULL);
+ #endif
+
+    memset(&pool, 0, sizeof(struct dec_pool));
+    pool.task = ak_dec_pool_re_encrypt_volume;
+    pool.bkey = bkey;
+    pool.in = in;
+    pool.out = out;
+    pool.w = w;
+    pool.s = s;
+    pool.v = v;
+    pool.l = l;
+    pool.l_j = l_j;
+    pool.ctrs.bsize = bkey->bsize;
+    pool.ctrs.flat = l_j_i;
+    pool.arg = &state;
+
+    error = ak_dec_pool_spawn(&pool, threads);
+
+ #ifdef LIBAKRYPT_HAVE_PTHREAD_H
+    pthread_mutex_destroy(&state.lock);
+ #endif
+    return error;
+}
+
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция зашифровывает в режиме `DEC` только изменённые секторы данных. Сектор i раздела j
+    зашифровывается (и его счётчик увеличивается), если в битовой шкале dirty установлен бит
+    с номером j*s+i (младший бит байта dirty[0] соответствует сектору 0). Для остальных секторов
+    шифртекст в области out и счётчики не изменяются, а ключи разделов, не содержащих изменённых
+    секторов, не вырабатываются.
+
+    Функция предназначена для повторного зашифрования образа после локальных изменений:
+    область out должна содержать шифртекст, полученный предыдущим вызовом, а область in --
+    изменённый открытый текст. Шкалу можно построить функцией \ref ak_dec_dirty_bitmap_compare().
+
+    @param bkey Контекст ключа алгоритма блочного шифрования.
+    @param in Указатель на область памяти, где хранятся входные данные.
+    @param out Указатель на область памяти, куда помещаются выходные данные.
+    @param size Размер данных (в байтах).
+    @param w Количество разделов, на которые делятся входные данные
+    @param s Количество секторов в разделе
+    @param v Частота смены ключа
+    @param l Длина сектора в байтах
+    @param l_j Указатель на область памяти, в которой хранятся счётчики для разделов
+    @param l_j_i Указатель на область памяти, в которой хранятся счётчики для секторов
+    @param dirty Битовая шкала изменённых секторов длиной не менее (w*s + 7)/8 байт.
+
+    @return В случае возникновения ошибки функция возвращает ее код, в противном случае
+    возвращается \ref ak_error_ok (ноль)                                                           */
+/* ----------------------------------------------------------------------------------------------- */
+int ak_bckey_encrypt_dec_dirty(ak_bckey bkey, ak_pointer in, ak_pointer out, size_t size, ak_uint64 w,
+                               ak_uint64 s, ak_uint64 v, ak_uint64 l, ak_pointer l_j, ak_pointer l_j_i,
+                               const ak_uint8 *dirty) {
+    int error = ak_error_ok;
+    struct dec_counter_view ctrs = { 0, NULL, NULL };
+    ak_dec_key_cache cache = NULL;
+
+    if((error = ak_dec_check_parameters(bkey, in, out, size, w, s, v, l, l_j, l_j_i)) != ak_error_ok) {
+        return ak_error_message(error, __func__, "incorrect parameters of dec mode");
+    }
+    if(dirty == NULL) {
+        return ak_error_message(ak_error_null_pointer, __func__, "using null pointer to dirty sectors bitmap");
     }
 
-    switch (bkey->bsize) {
-        case 8:
-            for(ak_uint64 j = 0; j < w; ++j) {
-                for(ak_uint64 i = 0; i < s; ++i) {
-                    if ((*l_j_i_ptr_8) + 1 == 0) {
-                        inptr -= i;
-                        outptr -= i;
-                        l_j_i_ptr_8 -= i;
-
-                        ak_bckey_re_encrypt_dec(bkey, inptr, outptr, size, w, s, v, l, l_j_ptr_8, l_j_i_ptr_8, j);
-                    }
-                    (*l_j_i_ptr_8)++;
-
-                    z0.q[0] = 0;
-
-                    P.q[0] = *l_j_ptr_8;
-                    P.q[0] <<= sizeof(P.q[0]) * 8 / 2;
-                    P.q[0] = P.q[0] + j;
-
-                    ak_kdf_state_create(&ks, bkey->key.key, bkey->key.key_size, xor_cmac_magma_kdf,
-                                        (ak_uint8 *) &P.q[0], sizeof(P.q[0]),
-                                        seed, sizeof(seed), (ak_uint8 *) &z0.q[0], sizeof(z0.q[0]), 32768);
-                    ak_kdf_state_next(&ks, k_j, sizeof(k_j));
-
-                    z0.q[0] = j;
-                    z0.q[0] <<= sizeof(z0.q[0]) * 8 / 2;
-
-                    P.q[0] = (*l_j_i_ptr_8) / v;
-                    P.q[0] <<= sizeof(P.q[0]) * 8 / 2;
-                    P.q[0] = P.q[0] + i;
-
-
-                    ak_kdf_state_create(&ks, k_j, sizeof(k_j), xor_cmac_magma_kdf, (ak_uint8 *) &P.q[0],
-                                        sizeof(P.q[0]),
-                                        seed, sizeof(seed), (ak_uint8 *) &z0.q[0], sizeof(z0.q[0]), 32768);
-                    ak_kdf_state_next(&ks, k_j_i, sizeof(k_j_i));
-
-                    for (ak_uint64 t = 0; t < q; ++t) {
-                        CTR.q[0] = i;
-                        CTR.q[0] <<= sizeof(CTR.q[0]) * 8 / 2;
-                        CTR.q[0] = CTR.q[0] + ((*l_j_i_ptr_8) * q + t);
-
-                        if((error = ak_bckey_create_magma(&internalContext)) != ak_error_ok ) {
-                            ak_error_message( error, __func__, "incorrect creation of magma secret key" );
-                            goto ext;
-                        }
-                        ak_bckey_set_key(&internalContext, k_j_i, sizeof(k_j_i));
-                        internalContext.encrypt(&internalContext.key, (ak_uint8 *) &CTR.q[0], delta);
-
-                        *outptr = *inptr ^ delta[0];
-                        inptr++;
-                        outptr++;
-                    }
-                    l_j_i_ptr_8++;
-                }
-                l_j_ptr_8++;
-            }
+    ctrs.bsize = bkey->bsize;
+    ctrs.flat = l_j_i;
+    cache = ak_dec_key_cache_find(bkey);
+    for(ak_uint64 j = 0; j < w; ++j) {
+        if((error = ak_dec_process_volume(bkey, in, out, s, v, l, l_j, &ctrs, cache, dirty, j,
+                                          ak_true)) != ak_error_ok) {
             break;
-
-            case 16:
-                for (ak_uint64 j = 0; j < w; ++j) {
-                    for (ak_uint64 i = 0; i < s; ++i) {
-                        if ((*l_j_i_ptr_16) + 1 == 0) {
-                            inptr -= i;
-                            outptr -= i;
-                            l_j_i_ptr_16 -= i;
-
-                            ak_bckey_re_encrypt_dec(bkey, inptr, outptr, size, w, s, v, l, l_j_ptr_16,
-                                               l_j_i_ptr_16, j);
-                        }
-                        (*l_j_i_ptr_16)++;
-
-                        P.q[1] = *l_j_ptr_16;
-                        P.q[0] = j;
-
-                        ak_kdf_state_create(&ks, bkey->key.key, bkey->key.key_size,
-                                            xor_cmac_kuznechik_kdf, (ak_uint8 *) &P, sizeof(ak_uint128),
-                                            seed, sizeof(seed), (ak_uint8 *) &z0, sizeof(ak_uint128),
-                                            32768);
-                        ak_kdf_state_next(&ks, k_j, sizeof(k_j));
-
-                        z0.q[1] = j;
-                        z0.q[0] = 0;
-
-                        P.q[1] = (*l_j_i_ptr_16) / v;
-                        P.q[0] = P.q[0] + i;
-
-                        ak_kdf_state_create(&ks, k_j, sizeof(k_j), xor_cmac_kuznechik_kdf,
-                                            (ak_uint8 *) &P, sizeof(ak_uint128),
-                                            seed, sizeof(seed), (ak_uint8 *) &z0, sizeof(ak_uint128),
-                                            32768);
-                        ak_kdf_state_next(&ks, k_j_i, sizeof(k_j_i));
-
-                        for (ak_uint64 t = 0; t < q; ++t) {
-                            CTR.q[1] = i;
-                            CTR.q[0] = ((*l_j_i_ptr_16) * q + t);
-
-                            if((error = ak_bckey_create_kuznechik(&internalContext)) != ak_error_ok ) {
-                                ak_error_message( error, __func__, "incorrect creation of kuznechik secret key" );
-                                goto ext;
-                            }
-                            ak_bckey_set_key(&internalContext, k_j_i, sizeof(k_j_i));
-                            internalContext.encrypt(&internalContext.key, (ak_uint8 *) &CTR, delta);
-
-                            *outptr = *inptr ^ delta[0];
-                            inptr++;
-                            outptr++;
-
-                            *outptr = *inptr ^ delta[1];
-                            inptr++;
-                            outptr++;
-                        }
-                        l_j_i_ptr_16++;
-                    }
-                    l_j_ptr_16++;
-                }
-                break;
+        }
     }
 
-ext:
     return error;
 }
 
 
 /* ----------------------------------------------------------------------------------------------- */
-/*! При вычислении открытого текста сообщения в режиме `DEC` каждый массив данных разбивают на разделы,
+/*! Функция строит битовую шкалу изменённых секторов для функции \ref ak_bckey_encrypt_dec_dirty(),
+    сравнивая прежний и новый открытый текст посекторно. Бит j*s+i устанавливается, если
+    содержимое сектора i раздела j различается.
+
+    @param old Указатель на прежний открытый текст.
+    @param in Указатель на новый открытый текст.
+    @param w Количество разделов
+    @param s Количество секторов в разделе
+    @param l Длина сектора в байтах
+    @param dirty Битовая шкала длиной не менее (w*s + 7)/8 байт.
+
+    @return Функция возвращает количество изменённых секторов.                                     */
+/* ----------------------------------------------------------------------------------------------- */
+ak_uint64 ak_dec_dirty_bitmap_compare(ak_const_pointer old, ak_const_pointer in, ak_uint64 w, ak_uint64 s,
+                                      ak_uint64 l, ak_uint8 *dirty) {
+    ak_uint64 count = 0;
+
+    if((old == NULL) || (in == NULL) || (dirty == NULL)) {
+        ak_error_message(ak_error_null_pointer, __func__, "using null pointer to dirty bitmap parameter");
+        return 0;
+    }
+
+    memset(dirty, 0, (size_t)((w * s + 7) / 8));
+    for(ak_uint64 idx = 0; idx < w * s; ++idx) {
+        if(memcmp((const ak_uint8 *)old + idx * l, (const ak_uint8 *)in + idx * l, (size_t)l) != 0) {
+            dirty[idx >> 3] |= (ak_uint8)(1 << (idx & 7));
+            count++;
+        }
+    }
+
+    return count;
+}
+
+
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! При перешифровании сообщения в режиме `DEC` каждый массив данных разбивают на разделы,
 	которые в свою очередь разбиваются на секторы, состоящие из q блоков.
 
 
@@ -245,10 +2864,12 @@ ext:
 	в соответствующих рекомендациях по стандартизации.
 
 
-	При расшифровании из входных параметров формируются производные из входного ключа ключи разделов,
+	При перешифровании из входных параметров формируются производные из входного ключа ключи разделов,
 	из которых реализуются производные ключи для секторов. Сектор делится на q блоков, которыми оперирует 
 	блочный шифр, и расшифровывается на данном ключе сектора.
 
+	Перешифрование применяется к конкретному разделу входных данных
+
     @param bkey Контекст ключа алгоритма блочного шифрования,
     используемый для шифрования и порождения цепочки производных ключей.
     @param in Указатель на область памяти, где хранятся входные данные.
@@ -264,26 +2885,10 @@ ext:
     @return В случае возникновения ошибки функция возвращает ее код, в противном случае
     возвращается \ref ak_error_ok (ноль)                                                           */
 /* ----------------------------------------------------------------------------------------------- */
-int ak_bckey_decrypt_dec(ak_bckey bkey, ak_pointer in, ak_pointer out, size_t size, ak_uint64 w, ak_uint64 s, ak_uint64 v,
-                    ak_uint64 l, ak_pointer l_j, ak_pointer l_j_i) {
+int ak_bckey_re_encrypt_dec(ak_bckey bkey, ak_pointer in, ak_pointer out, size_t size, ak_uint64 w, ak_uint64 s, ak_uint64 v,
+                       ak_uint64 l, ak_pointer l_j, ak_pointer l_j_i, ak_uint64 j) {
     int error = ak_error_ok;
-    ak_uint64 *inptr = (ak_uint64 *)in;
-    ak_uint64 *outptr = (ak_uint64 *)out;
-    ak_uint64 q = l / bkey->bsize;
-    struct kdf_state ks;
-    struct bckey internalContext;
-    ak_uint8 seed[32] = {0};
-    ak_uint8 k_j[32] = {0};
-    ak_uint8 k_j_i[32] = {0};
-    ak_uint64 delta[2] = {0};
-    ak_uint128 z0;
-    ak_uint128 P;
-    ak_uint128 CTR;
-    ak_uint32 *l_j_i_ptr_8 = (ak_uint32 *)l_j_i;
-    ak_uint32 *l_j_ptr_8 = (ak_uint32 *)l_j;
-    ak_uint64 *l_j_i_ptr_16 = (ak_uint64 *)l_j_i;
-    ak_uint64 *l_j_ptr_16 = (ak_uint64 *)l_j;
-
+    ak_uint64 q = 0;
 
     if((bkey->bsize != 8) &&  (bkey->bsize != 16)) {
         error = ak_error_wrong_block_cipher;
@@ -315,11 +2920,12 @@ int ak_bckey_decrypt_dec(ak_bckey bkey, ak_pointer in, ak_pointer out, size_t si
         goto ext;
     }
 
-    if(l % bkey->bsize != 0) {
+    if((l == 0) || (l % bkey->bsize != 0)) {
         error = ak_error_wrong_length;
         ak_error_message(error, __func__, "incorrect sector byte size");
         goto ext;
     }
+    q = l / bkey->bsize;
 
     if((ak_uint64)(2 << (bkey->bsize / 2)) % q != 0) {
         error = ak_error_wrong_length;
@@ -327,414 +2933,854 @@ int ak_bckey_decrypt_dec(ak_bckey bkey, ak_pointer in, ak_pointer out, size_t si
         goto ext;
     }
 
-    if((ak_uint64)(2 << (bkey->bsize / 2)) % w != 0) {
+    if((w == 0) || ((ak_uint64)(2 << (bkey->bsize / 2)) % w != 0)) {
         error = ak_error_wrong_length;
         ak_error_message(error, __func__, "incorrect number of volumes");
         goto ext;
     }
 
-    if((ak_uint64)(2 << (bkey->bsize / 2)) % s != 0) {
+    if((s == 0) || ((ak_uint64)(2 << (bkey->bsize / 2)) % s != 0)) {
         error = ak_error_wrong_length;
         ak_error_message(error, __func__, "incorrect number of sectors in a volume");
         goto ext;
     }
 
-    if(((ak_uint64)2 << (bkey->bsize / 2)) < v * q) {
+    if((v == 0) || (((ak_uint64)2 << (bkey->bsize / 2)) < v * q)) {
         error = ak_error_wrong_length;
         ak_error_message(error, __func__, "incorrect frequency of changing key_in");
         goto ext;
     }
 
-    switch (bkey->bsize) {
-        case 8:
-            for(ak_uint64 j = 0; j < w; ++j) {
-                for(ak_uint64 i = 0; i < s; ++i) {
-                    P.q[0] = *l_j_ptr_8;
-                    P.q[0] <<= sizeof(P.q[0]) * 8 / 2;
-                    P.q[0] = P.q[0] + j;
-
-                    ak_kdf_state_create(&ks, bkey->key.key, bkey->key.key_size, xor_cmac_magma_kdf, (ak_uint8 *)&P.q[0],
-                                        sizeof(P.q[0]), seed, sizeof(seed), (ak_uint8 *)&z0.q[0], sizeof(z0.q[0]), 32768);
-                    ak_kdf_state_next(&ks, k_j, sizeof(k_j));
-
-                    z0.q[0] = j;
-                    z0.q[0] <<= sizeof(z0.q[0]) * 8 / 2;
-
-                    P.q[0] = (*l_j_i_ptr_8) / v;
-                    P.q[0] <<= sizeof(P.q[0]) * 8 / 2;
-                    P.q[0] = P.q[0] + i;
-
-                    ak_kdf_state_create(&ks, k_j, sizeof(k_j), xor_cmac_magma_kdf, (ak_uint8 *)&P.q[0], sizeof(P.q[0]),
-                                        seed, sizeof(seed), (ak_uint8 *)&z0.q[0], sizeof(z0.q[0]), 32768);
-                    ak_kdf_state_next(&ks, k_j_i, sizeof(k_j_i));
-
-                    for(ak_uint64 t = 0; t < q; ++t) {
-                        CTR.q[0] = i;
-                        CTR.q[0] <<= sizeof(CTR.q[0]) * 8 / 2;
-                        CTR.q[0] = CTR.q[0] + ((*l_j_i_ptr_8) * q + t);
-
-                        if ((error = ak_bckey_create_magma(&internalContext)) != ak_error_ok) {
-                            ak_error_message(error, __func__, "incorrect creation of magma secret key");
-                            goto ext;
-                        }
-                        ak_bckey_set_key(&internalContext, k_j_i, sizeof(k_j_i));
-                        internalContext.encrypt(&internalContext.key, (ak_uint8 *) &CTR.q[0], delta);
-
-                        *outptr = *inptr ^ delta[0];
-                        inptr++;
-                        outptr++;
-                    }
-                    l_j_i_ptr_8++;
-                }
-                l_j_ptr_8++;
-            }
-            break;
-
-            case 16:
-                for(ak_uint64 j = 0; j < w; ++j) {
-                    for(ak_uint64 i = 0; i < s; ++i) {
-                        P.q[1] = *l_j_ptr_16;
-                        P.q[0] = j;
-
-                        ak_kdf_state_create(&ks, bkey->key.key, bkey->key.key_size, xor_cmac_kuznechik_kdf,
-                                            (ak_uint8 *)&P, sizeof(ak_uint128), seed, sizeof(seed), (ak_uint8 *)&z0,
-                                            sizeof(ak_uint128), 32768);
-                        ak_kdf_state_next(&ks, k_j, sizeof(k_j));
-                        z0.q[1] = j;
-                        z0.q[0] = 0;
-
-                        P.q[1] = (*l_j_i_ptr_16) / v;
-                        P.q[0] = 0;
-                        P.q[0] = i;
-
-
-                        ak_kdf_state_create(&ks, k_j, sizeof(k_j), xor_cmac_kuznechik_kdf, (ak_uint8 *)&P,
-                                            sizeof(ak_uint128), seed, sizeof(seed), (ak_uint8 *)&z0, sizeof(ak_uint128),
-                                            32768);
-                        ak_kdf_state_next(&ks, k_j_i, sizeof(k_j_i));
-
-                        for(ak_uint64 t = 0; t < q; ++t) {
-                            CTR.q[1] = i;
-                            CTR.q[0] = ((*l_j_i_ptr_16) * q + t);
-
-                            if((error = ak_bckey_create_kuznechik(&internalContext)) != ak_error_ok ) {
-                                ak_error_message( error, __func__, "incorrect creation of kuznechik secret key" );
-                                goto ext;
-                            }
-                            ak_bckey_set_key(&internalContext, k_j_i, sizeof(k_j_i));
-                            internalContext.encrypt(&internalContext.key, (ak_uint8 *)&CTR, delta);
-
-                            *outptr = *inptr ^ delta[0];
-                            inptr++;
-                            outptr++;
-                            *outptr = *inptr ^ delta[1];
-                            inptr++;
-                            outptr++;
-                        }
-                        l_j_i_ptr_16++;
-                    }
-                    l_j_ptr_16++;
-                }
-                break;
+    if(size < s * l) {
+        error = ak_error_wrong_length;
+        ak_error_message(error, __func__, "data length is less than s*l bytes");
+        goto ext;
     }
 
+    error = ak_dec_re_encrypt_sectors(bkey, in, out, s, v, l, l_j, l_j_i, j, s, NULL);
+
 ext:
     return error;
 }
 
-
 /* ----------------------------------------------------------------------------------------------- */
-/*! При перешифровании сообщения в режиме `DEC` каждый массив данных разбивают на разделы,
-	которые в свою очередь разбиваются на секторы, состоящие из q блоков.
-
-
-    Длины раздела и сектора является параметром алгоритма и должна удовлетворять требованиям, определёнынм
-	в соответствующих рекомендациях по стандартизации.
-
-
-	При перешифровании из входных параметров формируются производные из входного ключа ключи разделов,
-	из которых реализуются производные ключи для секторов. Сектор делится на q блоков, которыми оперирует 
-	блочный шифр, и расшифровывается на данном ключе сектора.
-
-	Перешифрование применяется к конкретному разделу входных данных
-
-    @param bkey Контекст ключа алгоритма блочного шифрования,
-    используемый для шифрования и порождения цепочки производных ключей.
-    @param in Указатель на область памяти, где хранятся входные данные.
-    @param out Указатель на область памяти, куда помещаются выходные данные.
-    @param size Размер данных (в байтах), для которых вычисляется имитовставка. 
-    @param w Количество разделов, на которые делятся входные данные
-    @param s Количество секторов в разделе
-	@param v Частота смены ключа
-    @param l Длина сектора в байтах
-	@param l_j Указатель на область памяти, в которой хранятся счётчики для разделов
-	@param l_j_i Указатель на область памяти, в которой хранятся счётчики для секторов
-
-    @return В случае возникновения ошибки функция возвращает ее код, в противном случае
-    возвращается \ref ak_error_ok (ноль)                                                           */
+/*                           подбор параметров режима для текущей машины                           */
 /* ----------------------------------------------------------------------------------------------- */
-int ak_bckey_re_encrypt_dec(ak_bckey bkey, ak_pointer in, ak_pointer out, size_t size, ak_uint64 w, ak_uint64 s, ak_uint64 v,
-                       ak_uint64 l, ak_pointer l_j, ak_pointer l_j_i, ak_uint64 j) {
-    int error = ak_error_ok;
-    ak_uint64 *inptr = (ak_uint64 *)in;
-    ak_uint64 *outptr = (ak_uint64 *)out;
-    ak_uint64 q = l / bkey->bsize;
-    struct kdf_state ks;
-    struct bckey internalContext;
-    ak_uint8 seed[32] = {0};
-    ak_uint8 k_j[32] = {0};
-    ak_uint8 k_j_i[32] = {0};
-    ak_uint8 k_j_sh[32] = {0};
-    ak_uint8 k_j_i_sh[32] = {0};
-    ak_uint128 z0;
-    ak_uint128 P;
-    ak_uint128 CTR;
-    ak_uint128 CTR_sh;
-    ak_uint64 delta[2];
-    ak_uint64 delta_sh[2];
-    ak_uint32 *l_j_i_ptr_8 = (ak_uint32 *)l_j_i;
-    ak_uint32 *l_j_ptr_8 = (ak_uint32 *)l_j;
-    ak_uint32 l_j_i_old_8 = 0;
-    ak_uint64 *l_j_i_ptr_16 = (ak_uint64 *)l_j_i;
-    ak_uint64 *l_j_ptr_16 = (ak_uint64 *)l_j;
-    ak_uint64 l_j_i_old_16 = 0;
-
-
-    if((bkey->bsize != 8) &&  (bkey->bsize != 16)) {
-        error = ak_error_wrong_block_cipher;
-        ak_error_message(error, __func__ , "incorrect block size of block cipher key");
-        goto ext;
-    }
-
-    if(l_j == NULL) {
-        error = ak_error_null_pointer;
-        ak_error_message(error, __func__, "incorrect pointer to l_j");
-        goto ext;
-    }
+/*! Функция возвращает значение монотонных часов в наносекундах.                                  */
+/* ----------------------------------------------------------------------------------------------- */
+static ak_uint64 ak_dec_clock(void) {
+#ifdef LIBAKRYPT_HAVE_TIME_H
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ak_uint64)ts.tv_sec * 1000000000LL + (ak_uint64)ts.tv_nsec;
+#else
+    return 0;
+#endif
+}
 
-    if(l_j_i == NULL) {
-        error = ak_error_null_pointer;
-        ak_error_message(error, __func__, "incorrect pointer to l_j_i");
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция измеряет производительность зашифрования одного раздела из s секторов длины l
+    при частоте смены ключа v (значения берутся из geometry) для заданного профиля нагрузки
+    и заполняет остальные поля geometry. Разделы обрабатываются независимо и одинаково,
+    поэтому измерения выполняются на одном разделе; объём памяти счётчиков вычисляется для w разделов.
+    При измерении зашифровывается около budget байт данных. Временные данные и счётчики
+    затираются перед освобождением памяти.                                                         */
+/* ----------------------------------------------------------------------------------------------- */
+static int ak_dec_tune_geometry(ak_bckey bkey, ak_uint64 w, dec_profile_t profile, ak_uint64 budget,
+                                ak_dec_geometry geometry) {
+    int error = ak_error_ok;
+    ak_uint64 l = geometry->l, s = geometry->s, v = geometry->v;
+    size_t csize = bkey->bsize / 2, size = (size_t)(s * l);
+    ak_uint8 *data = NULL, *counters = NULL, *dirty = NULL;
+    ak_uint64 rounds = 0, bytes = 0, derivations = 0, start = 0, elapsed = 0, kdf = 0;
+    ak_uint64 i = 0, x = 0x9e3779b97f4a7c15LL;
+    struct dec_counters ctrs;
+    struct dec_workspace local;
+    ak_dec_workspace ws = NULL;
+    ak_dec_arena arena = NULL;
+    size_t mark = 0;
+
+    /* объём памяти, занимаемой счётчиками разделов и секторов */
+    if((error = ak_dec_counters_create(&ctrs, bkey->bsize, w, s)) != ak_error_ok) return error;
+    geometry->flat_counters_size = (size_t)(w * (s + 1) * csize);
+    geometry->compact_counters_size = ak_dec_counters_get_memory_size(&ctrs) + (size_t)(w * csize);
+    ak_dec_counters_destroy(&ctrs);
+
+    if(((data = calloc(size, 1)) == NULL) || ((counters = calloc((size_t)(s + 1), csize)) == NULL) ||
+       ((dirty = calloc((size_t)((s + 7) / 8), 1)) == NULL)) {
+        error = ak_error_message(ak_error_out_of_memory, __func__, "incorrect memory allocation for benchmark");
         goto ext;
     }
 
-    if(in == NULL) {
-        error = ak_error_null_pointer;
-        ak_error_message(error, __func__, "incorrect pointer to plain text");
-        goto ext;
+    start = ak_dec_clock();
+    if(profile == dec_sequential_profile) {
+        /* последовательная запись: раздел перезаписывается целиком */
+        if((rounds = budget / size) == 0) rounds = 1;
+        for(ak_uint64 r = 0; r < rounds; ++r) {
+            if((error = ak_bckey_encrypt_dec(bkey, data, data, size, 1, s, v, l, counters,
+                                             counters + csize)) != ak_error_ok) goto ext;
+            bytes += size;
+            derivations += s + 1;
+        }
+    } else {
+        /* запись отдельных секторов: блоков по ak_dec_tune_small_write байт в случайных местах
+           (запись занимает n соседних секторов, а при l больше длины блока -- часть сектора,
+           который всё равно зашифровывается целиком) либо небольшого множества часто
+           изменяемых секторов */
+        ak_uint64 n = 1, payload = l;
+
+        if(profile == dec_random_small_profile) {
+            if((n = (ak_dec_tune_small_write + l - 1) / l) > s) n = s;
+            payload = (size < ak_dec_tune_small_write) ? size : ak_dec_tune_small_write;
+        }
+        if((rounds = budget / payload) > ak_dec_tune_writes) rounds = ak_dec_tune_writes;
+        if(rounds == 0) rounds = 1;
+        for(ak_uint64 r = 0; r < rounds; ++r) {
+            if(profile == dec_random_small_profile) {
+                x ^= x << 13;
+                x ^= x >> 7;
+                x ^= x << 17;
+                i = (x % (s / n)) * n;
+            } else i = r % ((s < ak_dec_tune_hot_sectors) ? s : ak_dec_tune_hot_sectors);
+
+            for(ak_uint64 k = i; k < i + n; ++k) dirty[k >> 3] |= (ak_uint8)(1 << (k & 7));
+            if((error = ak_bckey_encrypt_dec_dirty(bkey, data, data, size, 1, s, v, l, counters,
+                                                   counters + csize, dirty)) != ak_error_ok) goto ext;
+            for(ak_uint64 k = i; k < i + n; ++k) dirty[k >> 3] = 0;
+            bytes += payload;
+            derivations += n + 1;
+        }
     }
+    if((elapsed = ak_dec_clock() - start) == 0) elapsed = 1;
 
-    if(out == NULL) {
-        error = ak_error_null_pointer;
-        ak_error_message(error, __func__, "incorrect pointer to cipher text");
+    /* трудоёмкость выработки производных ключей оценивается по выборке */
+    if((ws = ak_dec_workspace_acquire(&local, &arena, &mark)) == NULL) {
+        error = ak_error_out_of_memory;
         goto ext;
     }
+    start = ak_dec_clock();
+    if((error = ak_dec_derive_volume_key(ws, bkey, 0, 0, ws->k_j)) == ak_error_ok) {
+        for(ak_uint64 k = 1; k < ak_dec_tune_kdf_samples; ++k) {
+            if((error = ak_dec_derive_sector_key(ws, bkey->bsize, ws->k_j, 0, k % s, k, ws->k_j_i)) != ak_error_ok) break;
+        }
+    }
+    kdf = (ak_dec_clock() - start) * derivations / ak_dec_tune_kdf_samples;
+    ak_dec_workspace_release(ws, arena, mark);
+    if(error != ak_error_ok) goto ext;
 
-    if(l % bkey->bsize != 0) {
-        error = ak_error_wrong_length;
-        ak_error_message(error, __func__, "incorrect sector byte size");
-        goto ext;
+    geometry->throughput = (double)bytes * 1000000000.0 / (double)elapsed;
+    geometry->kdf_overhead = (kdf < elapsed) ? (double)kdf / (double)elapsed : 1.0;
+
+ext:
+    if(dirty != NULL) ak_dec_wipe(dirty, (size_t)((s + 7) / 8));
+    free(dirty);
+    if(counters != NULL) ak_dec_wipe(counters, (size_t)(s + 1) * csize);
+    free(counters);
+    if(data != NULL) ak_dec_wipe(data, size);
+    free(data);
+    return error;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция выполняет подбор параметров режима \ref ak_bckey_tune_dec(), зашифровывая при
+    измерении каждой геометрии около budget байт данных. Небольшой объём используется
+    при тестировании.                                                                              */
+/* ----------------------------------------------------------------------------------------------- */
+static int ak_dec_tune(ak_bckey bkey, size_t size, ak_uint64 w, dec_profile_t profile, ak_uint64 budget,
+                       ak_dec_geometry geometry, size_t *count, ak_dec_geometry best) {
+    int error = ak_error_ok;
+    ak_uint64 limit = 0, s = 0;
+    size_t found = 0, choice = 0;
+    struct dec_geometry measured[ak_dec_tune_max_geometries];
+    double peak = 0.0;
+    struct bckey bench;
+    struct random generator;
+
+#ifndef LIBAKRYPT_HAVE_TIME_H
+    return ak_error_message(ak_error_undefined_function, __func__, "monotonic clock is not available");
+#endif
+    if((bkey == NULL) || (best == NULL)) {
+        return ak_error_message(ak_error_null_pointer, __func__, "using null pointer to key or result");
+    }
+    if((geometry != NULL) && (count == NULL)) {
+        return ak_error_message(ak_error_null_pointer, __func__, "using null pointer to size of results");
+    }
+    if((bkey->bsize != 8) && (bkey->bsize != 16)) {
+        return ak_error_message(ak_error_wrong_block_cipher, __func__ , "incorrect block size of block cipher key");
+    }
+    if((profile != dec_sequential_profile) && (profile != dec_random_small_profile) &&
+       (profile != dec_write_heavy_profile)) {
+        return ak_error_message(ak_error_undefined_value, __func__, "incorrect workload profile");
+    }
+    limit = (ak_uint64)2 << (bkey->bsize / 2);
+    if((w == 0) || (limit % w != 0)) {
+        return ak_error_message(ak_error_wrong_length, __func__, "incorrect number of volumes");
     }
 
-    if((ak_uint64)(2 << (bkey->bsize / 2)) % q != 0) {
-        error = ak_error_wrong_length;
-        ak_error_message(error, __func__, "incorrect number of blocks in a sector");
+    /* измерения выполняются с временным случайным ключом, так что ключ bkey и подключённый
+       к нему кэш производных ключей не используются */
+    if((error = ((bkey->bsize == 8) ? ak_bckey_create_magma(&bench) :
+                                      ak_bckey_create_kuznechik(&bench))) != ak_error_ok) {
+        return ak_error_message(error, __func__, "incorrect creation of temporary key");
+    }
+    if((error = ak_random_create_lcg(&generator)) != ak_error_ok) {
+        ak_error_message(error, __func__, "incorrect creation of random generator");
         goto ext;
     }
-
-    if((ak_uint64)(2 << (bkey->bsize / 2)) % w != 0) {
-        error = ak_error_wrong_length;
-        ak_error_message(error, __func__, "incorrect number of volumes");
+    error = ak_bckey_set_key_random(&bench, &generator);
+    ak_random_destroy(&generator);
+    if(error != ak_error_ok) {
+        ak_error_message(error, __func__, "incorrect generation of temporary key");
         goto ext;
     }
 
-    if((ak_uint64)(2 << (bkey->bsize / 2)) % s != 0) {
-        error = ak_error_wrong_length;
-        ak_error_message(error, __func__, "incorrect number of sectors in a volume");
+    for(ak_uint64 q = 1; q <= limit; q <<= 1) {
+        ak_uint64 l = q * bkey->bsize;
+        ak_uint64 v[2] = { 1, limit / q };
+
+        if((l < ak_dec_tune_min_sector) || (l > ak_dec_tune_max_sector)) continue;
+        /* разделы должны охватывать данные целиком */
+        if((size % (w * l) != 0) || ((s = size / (w * l)) == 0) || (s > limit) || (limit % s != 0)) continue;
+
+        for(size_t k = 0; (k < 2) && (found < ak_dec_tune_max_geometries); ++k) {
+            if((k == 1) && (v[1] == v[0])) break;
+
+            memset(measured + found, 0, sizeof(struct dec_geometry));
+            measured[found].l = l;
+            measured[found].s = s;
+            measured[found].v = v[k];
+            if((error = ak_dec_tune_geometry(&bench, w, profile, budget, measured + found)) != ak_error_ok) {
+                ak_error_message(error, __func__, "incorrect benchmark of dec geometry");
+                goto ext;
+            }
+            found++;
+        }
+    }
+    if(found == 0) {
+        error = ak_error_message(ak_error_wrong_length, __func__, "data length cannot be covered by any geometry");
         goto ext;
     }
 
-    if(((ak_uint64)2 << (bkey->bsize / 2)) < v * q) {
-        error = ak_error_wrong_length;
-        ak_error_message(error, __func__, "incorrect frequency of changing key_in");
-        goto ext;
+    for(size_t k = 0; k < found; ++k) {
+        if(measured[k].throughput > peak) {
+            peak = measured[k].throughput;
+            choice = k;
+        }
+    }
+    for(size_t k = 0; k < found; ++k) {
+        if(measured[k].throughput < 0.95 * peak) continue;
+        if((measured[k].compact_counters_size < measured[choice].compact_counters_size) ||
+           ((measured[k].compact_counters_size == measured[choice].compact_counters_size) &&
+            ((measured[k].flat_counters_size < measured[choice].flat_counters_size) ||
+             ((measured[k].flat_counters_size == measured[choice].flat_counters_size) &&
+              (measured[k].v < measured[choice].v))))) choice = k;
     }
+    *best = measured[choice];
 
-  
-    switch (bkey->bsize) {
-        case 8:
-            if ((*l_j_ptr_8) + 1 == 0) {
-                error = ak_error_wrong_key_icode;
-                ak_error_message(error, __func__, "Key_in is can not be used anymore");
-                goto ext;
-            }
-            z0.q[0] = 0;
-            P.q[0] = *l_j_ptr_8;
-            P.q[0] <<= sizeof(P.q[0]) * 8 / 2;
-            P.q[0] = P.q[0] + j;
+    if(geometry != NULL) {
+        memcpy(geometry, measured, ((*count < found) ? *count : found) * sizeof(struct dec_geometry));
+    }
+    if(count != NULL) *count = found;
 
-            ak_kdf_state_create(&ks, bkey->key.key, bkey->key.key_size, xor_cmac_magma_kdf, (ak_uint8 *)&P.q[0],
-                                sizeof(P.q[0]), seed, sizeof(seed), (ak_uint8 *)&z0.q[0], sizeof(z0.q[0]), 32768);
-            ak_kdf_state_next(&ks, k_j, sizeof(k_j));
-            for(ak_uint64 i = 0; i < s; ++i) {
-                z0.q[0] = j;
-                z0.q[0] <<= sizeof(z0.q[0]) * 8 / 2;
+ext:
+    ak_bckey_destroy(&bench);
+    return error;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция подбирает параметры режима `DEC` (длину сектора l, количество секторов в разделе s
+    и частоту смены ключа v), обеспечивающие наибольшую производительность на текущей машине
+    для заданного профиля нагрузки:
+     - \ref dec_sequential_profile -- разделы перезаписываются целиком;
+     - \ref dec_random_small_profile -- записываются блоки по 512 байт в случайных местах
+       (производительность учитывает только записанные байты, поэтому длинные секторы,
+       зашифровываемые целиком ради небольшой записи, проигрывают);
+     - \ref dec_write_heavy_profile -- многократно перезаписывается небольшое множество секторов,
+       так что счётчики секторов растут быстро, а смена ключей секторов происходит часто.
+
+    Перебираются все допустимые длины сектора от 64 до 4096 байт (количество блоков в секторе
+    должно делить 2 << (bsize/2)). При заданных w, l и объёме данных size количество секторов
+    не является свободным параметром: s = size/(w*l), и длина сектора рассматривается, только
+    если разделы охватывают данные целиком (w*s*l = size), а s делит 2 << (bsize/2).
+    Для каждой длины сектора рассматриваются наименьшая (v = 1) и наибольшая допустимая
+    частота смены ключа. Если ни одна длина сектора не позволяет охватить данные целиком,
+    функция возвращает ошибку \ref ak_error_wrong_length.
+
+    Для каждой геометрии измеряются производительность, доля времени, затрачиваемого на выработку
+    производных ключей, и объём памяти счётчиков в виде плоского массива и в компактном
+    представлении (\ref ak_dec_counters_create()). Рекомендуется геометрия с наибольшей
+    производительностью, а среди геометрий, уступающих ей не более 5%, -- с наименьшим объёмом счётчиков в компактном
+    представлении, при равенстве -- с наименьшим объёмом плоских массивов счётчиков и затем
+    с наименьшей частотой смены ключа v.
+
+    Измерения выполняются на временных данных и временных счётчиках раздела 0 со временным
+    ключом того же алгоритма блочного шифрования, выработанным случайно: ключ bkey используется
+    только для выбора алгоритма, поэтому функцию можно вызывать одновременно с функциями
+    шифрования в других потоках, а подключённый к ключу кэш производных ключей
+    (\ref ak_dec_key_cache_open()) не используется и не изменяется.
+
+    @param bkey Контекст ключа алгоритма блочного шифрования.
+    @param size Объём шифруемых данных (в байтах).
+    @param w Количество разделов.
+    @param profile Профиль нагрузки.
+    @param geometry Массив, в который помещаются результаты измерений для всех геометрий
+    (может быть NULL).
+    @param count Указатель на размер массива geometry; после выполнения функции содержит
+    количество измеренных геометрий (может быть NULL, если geometry равен NULL).
+    @param best Рекомендуемая геометрия.
+
+    @return В случае возникновения ошибки функция возвращает ее код, в противном случае
+    возвращается \ref ak_error_ok (ноль)                                                           */
+/* ----------------------------------------------------------------------------------------------- */
+int ak_bckey_tune_dec(ak_bckey bkey, size_t size, ak_uint64 w, dec_profile_t profile,
+                      ak_dec_geometry geometry, size_t *count, ak_dec_geometry best) {
+    return ak_dec_tune(bkey, size, w, profile, ak_dec_tune_bytes, geometry, count, best);
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция проверяет выработку гаммы алгоритма Кузнечик: значение счётчика, равное открытому
+    тексту из ГОСТ Р 34.12-2015 (приложение А.1), должно зашифровываться в шифртекст из стандарта,
+    а выбранная при запуске функция выработки гаммы -- совпадать с переносимой на числе блоков,
+    не кратном числу одновременно обрабатываемых блоков, в том числе при переполнении счётчика. */
+/* ----------------------------------------------------------------------------------------------- */
+static bool_t ak_libakrypt_test_dec_kuznechik(const ak_uint8 *key) {
+    ak_uint8 plain[16] = {
+            0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff, 0x00, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11 };
+    ak_uint8 cipher[16] = {
+            0xcd, 0xed, 0xd4, 0xb9, 0x42, 0x8d, 0x46, 0x5a, 0x30, 0x24, 0xbc, 0xbe, 0x90, 0x9d, 0x67, 0x7f };
+    ak_dec_kuznechik_ctr_function *kernel = ak_dec_kuznechik_prepare();
+    ak_uint64 lo, hi, zero[2] = {0, 0}, block[2], in[74], out[74], expected[74];
+    ak_uint64 start = 0xffffffffffffffecLL;
+    ak_uint128 rk[10];
+
+    memcpy(&lo, plain, 8);
+    memcpy(&hi, plain + 8, 8);
+    ak_dec_kuznechik_schedule_keys(key, rk);
+
+    ak_dec_kuznechik_ctr_generic(rk, hi, lo, 1, zero, block);
+    if(memcmp(block, cipher, 16) != 0) return ak_false;
+    kernel(rk, hi, lo, 1, zero, block);
+    if(memcmp(block, cipher, 16) != 0) return ak_false;
+
+    for(size_t x = 0; x < 74; ++x) in[x] = expected[x] = (ak_uint64)x * 0x9e3779b97f4a7c15LL;
+    ak_dec_kuznechik_ctr_generic(rk, 5, start, 37, expected, expected);
+    kernel(rk, 5, start, 37, in, out);
+
+    return (memcmp(out, expected, sizeof(out)) == 0);
+}
 
-                P.q[0] = (*l_j_i_ptr_8) / v;
-                P.q[0] <<= sizeof(P.q[0]) * 8 / 2;
-                P.q[0] = P.q[0] + i;
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция сравнивает шифртекст, выработанный функцией \ref ak_bckey_encrypt_dec(), с шифртекстом,
+    вычисленным непосредственно по определению режима: ключи разделов и секторов вырабатываются
+    функцией выработки производных ключей, а гамма -- поблочным зашифрованием значений счётчика,
+    как это делалось до выделения общих функций режима. Используются два раздела, поэтому
+    проверяется и формат ключей разделов с ненулевыми номерами.                                   */
+/* ----------------------------------------------------------------------------------------------- */
+static bool_t ak_libakrypt_test_dec_reference(ak_bckey key) {
+    ak_uint64 w = 2, s = 2, v = 1, q = 2, l = q * key->bsize, c = 0;
+    ak_uint8 in[128], out[128], expected[128];
+    ak_uint64 l_j[2] = {0}, l_j_i[4] = {0};
+    ak_uint8 seed[32] = {0}, k_j[32], k_j_i[32];
+    ak_uint128 z0, P, CTR, gamma;
+    struct kdf_state ks;
+    struct bckey sector;
+    bool_t result = ak_false;
+
+    for(size_t x = 0; x < sizeof(in); ++x) in[x] = (ak_uint8)(x * 7 + 3);
+    if(ak_bckey_encrypt_dec(key, in, out, w * s * l, w, s, v, l, l_j, l_j_i) != ak_error_ok) return ak_false;
+
+    for(ak_uint64 j = 0; j < w; ++j) {
+        for(ak_uint64 i = 0; i < s; ++i) {
+            c = ak_dec_counter_get(key->bsize, l_j_i, j * s + i);
+            memset(&z0, 0, sizeof(z0));
+            memset(&P, 0, sizeof(P));
+
+            /* ключ раздела: P = (l_j, j), z0 = 0 */
+            if(key->bsize == 8) {
+                P.q[0] = (ak_dec_counter_get(8, l_j, j) << 32) + j;
+                ak_kdf_state_create(&ks, key->key.key, key->key.key_size, xor_cmac_magma_kdf, (ak_uint8 *)&P.q[0],
+                                    sizeof(P.q[0]), seed, sizeof(seed), (ak_uint8 *)&z0.q[0], sizeof(z0.q[0]), 32768);
+            } else {
+                P.q[1] = ak_dec_counter_get(16, l_j, j);
+                P.q[0] = j;
+                ak_kdf_state_create(&ks, key->key.key, key->key.key_size, xor_cmac_kuznechik_kdf, (ak_uint8 *)&P,
+                                    sizeof(P), seed, sizeof(seed), (ak_uint8 *)&z0, sizeof(z0), 32768);
+            }
+            ak_kdf_state_next(&ks, k_j, sizeof(k_j));
+            ak_kdf_state_destroy(&ks);
 
+            /* ключ сектора: P = (l_j_i / v, i), z0 = (j, 0) */
+            if(key->bsize == 8) {
+                z0.q[0] = j << 32;
+                P.q[0] = ((c / v) << 32) + i;
                 ak_kdf_state_create(&ks, k_j, sizeof(k_j), xor_cmac_magma_kdf, (ak_uint8 *)&P.q[0], sizeof(P.q[0]),
                                     seed, sizeof(seed), (ak_uint8 *)&z0.q[0], sizeof(z0.q[0]), 32768);
-                ak_kdf_state_next(&ks, k_j_i, sizeof(k_j_i));
+            } else {
+                z0.q[1] = j;
+                P.q[1] = c / v;
+                P.q[0] = i;
+                ak_kdf_state_create(&ks, k_j, sizeof(k_j), xor_cmac_kuznechik_kdf, (ak_uint8 *)&P, sizeof(P),
+                                    seed, sizeof(seed), (ak_uint8 *)&z0, sizeof(z0), 32768);
+            }
+            ak_kdf_state_next(&ks, k_j_i, sizeof(k_j_i));
+            ak_kdf_state_destroy(&ks);
+
+            /* гамма: зашифрованные значения счётчика (i, l_j_i*q + t) */
+            if(key->bsize == 8) ak_bckey_create_magma(&sector);
+            else ak_bckey_create_kuznechik(&sector);
+            ak_bckey_set_key(&sector, k_j_i, sizeof(k_j_i));
+            for(ak_uint64 t = 0; t < q; ++t) {
+                ak_uint8 *src = in + (j * s + i) * l + t * key->bsize;
+                ak_uint8 *dst = expected + (j * s + i) * l + t * key->bsize;
+
+                memset(&CTR, 0, sizeof(CTR));
+                if(key->bsize == 8) CTR.q[0] = (i << 32) + c * q + t;
+                else {
+                    CTR.q[1] = i;
+                    CTR.q[0] = c * q + t;
+                }
+                sector.encrypt(&sector.key, &CTR, &gamma);
+                for(size_t b = 0; b < key->bsize; ++b) dst[b] = src[b] ^ gamma.b[b];
+            }
+            ak_bckey_destroy(&sector);
+        }
+    }
+    result = (memcmp(out, expected, (size_t)(w * s * l)) == 0);
 
-                z0.q[0] = 0;
+    ak_dec_wipe(k_j, sizeof(k_j));
+    ak_dec_wipe(k_j_i, sizeof(k_j_i));
+    return result;
+}
 
-                P.q[0] = (*l_j_ptr_8) + 1;
-                P.q[0] <<= sizeof(P.q[0]) * 8 / 2;
-                P.q[0] = P.q[0] + j;
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция проверяет зашифрование на месте при исчерпании счётчика сектора: раздел перешифровывается
+    посреди обработки, при этом секторы, ещё содержащие открытый текст, не должны изменяться.    */
+/* ----------------------------------------------------------------------------------------------- */
+static bool_t ak_libakrypt_test_dec_exhaustion(ak_bckey key) {
+    ak_uint64 w = 2, s = 4, v = 1, l = 2 * key->bsize;
+    ak_uint8 in[256], buf[256], out[256];
+    ak_uint64 l_j[2] = {0}, l_j_i[8] = {0};
 
-                ak_kdf_state_create(&ks, bkey->key.key, bkey->key.key_size, xor_cmac_magma_kdf, (ak_uint8 *)&P.q[0],
-                                    sizeof(P.q[0]), seed, sizeof(seed), (ak_uint8 *)&z0.q[0], sizeof(z0.q[0]), 32768);
-                ak_kdf_state_next(&ks, k_j_sh, sizeof(k_j_sh));
+    for(size_t x = 0; x < sizeof(in); ++x) in[x] = (ak_uint8)(x * 13 + 5);
+    memcpy(buf, in, sizeof(in));
+    ak_dec_counter_set(key->bsize, l_j_i, 2, ak_dec_counter_max(key->bsize));
 
-                l_j_i_old_8 = *l_j_i_ptr_8;
-                *l_j_i_ptr_8 = 0;
+    if(ak_bckey_encrypt_dec(key, buf, buf, w * s * l, w, s, v, l, l_j, l_j_i) != ak_error_ok) return ak_false;
+    if((ak_dec_counter_get(key->bsize, l_j, 0) != 1) || (ak_dec_counter_get(key->bsize, l_j_i, 2) != 1)) {
+        return ak_false;
+    }
+    if(ak_bckey_decrypt_dec(key, buf, out, w * s * l, w, s, v, l, l_j, l_j_i) != ak_error_ok) return ak_false;
 
-                z0.q[0] = 0;
-                z0.q[0] = j;
-                z0.q[0] <<= sizeof(z0.q[0]) * 8 / 2;
+    return (memcmp(in, out, (size_t)(w * s * l)) == 0);
+}
 
-                P.q[0] = (*l_j_i_ptr_8) / v;
-                P.q[0] <<= sizeof(P.q[0]) * 8 / 2;
-                P.q[0] = P.q[0] + i;
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция проверяет обработку набора заданий на ключах разных алгоритмов, одно из которых
+    содержит некорректные параметры: код ошибки должен устанавливаться для каждого задания
+    независимо, а корректные задания -- выполняться так же, как при отдельных вызовах.          */
+/* ----------------------------------------------------------------------------------------------- */
+static bool_t ak_libakrypt_test_dec_batch(ak_uint8 *skey, size_t skey_size) {
+    struct bckey magma, kuznechik;
+    struct dec_job jobs[4];
+    ak_uint8 in[4][128], out[4][128], dec[128];
+    ak_uint64 l_j[4][2], l_j_i[4][4];
+    bool_t result = ak_false;
+    int error = ak_error_ok;
 
-                ak_kdf_state_create(&ks, k_j_sh, sizeof(k_j_sh), xor_cmac_magma_kdf, (ak_uint8 *)&P.q[0], sizeof(P.q[0]),
-                                    seed, sizeof(seed), (ak_uint8 *)&z0.q[0], sizeof(z0.q[0]), 32768);
-                ak_kdf_state_next(&ks, k_j_i_sh, sizeof(k_j_i_sh));
-
-                for(ak_uint64 t = 0; t < q; ++t) {
-                    CTR.q[0] = i;
-                    CTR.q[0] <<= sizeof(CTR.q[0]) * 8 / 2;
-                    CTR.q[0] = CTR.q[0] + (l_j_i_old_8 * q + t);
-
-                    if((error = ak_bckey_create_magma(&internalContext)) != ak_error_ok ) {
-                        ak_error_message( error, __func__, "incorrect creation of magma secret key" );
-                        goto ext;
-                    }
-                    ak_bckey_set_key(&internalContext, k_j_i, sizeof(k_j_i));
-                    internalContext.encrypt(&internalContext.key, (ak_uint8 *)&CTR.q[0], delta);
-                    ak_bckey_destroy(&internalContext);
-
-                    CTR_sh.q[0] = i;
-                    CTR_sh.q[0] <<= sizeof(CTR_sh.q[0]) * 8 / 2;
-                    CTR_sh.q[0] = CTR_sh.q[0] + ((*l_j_i_ptr_8) * q + t);
-
-                    if((error = ak_bckey_create_magma(&internalContext)) != ak_error_ok ) {
-                        ak_error_message( error, __func__, "incorrect creation of magma secret key" );
-                        goto ext;
-                    }
-                    ak_bckey_set_key(&internalContext, k_j_i_sh, sizeof(k_j_i_sh));
-                    internalContext.encrypt(&internalContext.key, (ak_uint8 *)&CTR_sh.q[0], delta_sh);
-                    ak_bckey_destroy(&internalContext);
-
-                    *outptr = *inptr ^ delta_sh[0] ^ delta[0];
-                    inptr++;
-                    outptr++;
-                }
-                l_j_i_ptr_8++;
-            }
+    if(ak_bckey_create_magma(&magma) != ak_error_ok) return ak_false;
+    if(ak_bckey_create_kuznechik(&kuznechik) != ak_error_ok) {
+        ak_bckey_destroy(&magma);
+        return ak_false;
+    }
+    if((ak_bckey_set_key(&magma, skey, skey_size) != ak_error_ok) ||
+       (ak_bckey_set_key(&kuznechik, skey, skey_size) != ak_error_ok)) goto ext;
 
-            (*l_j_ptr_8)++;
-            break;
+    memset(jobs, 0, sizeof(jobs));
+    memset(l_j, 0, sizeof(l_j));
+    memset(l_j_i, 0, sizeof(l_j_i));
+    memset(out, 0, sizeof(out));
+    for(size_t n = 0; n < 4; ++n) {
+        for(size_t x = 0; x < sizeof(in[n]); ++x) in[n][x] = (ak_uint8)(x * 3 + n * 41);
+        jobs[n].bkey = (n % 2 == 0) ? &magma : &kuznechik;
+        jobs[n].in = in[n];
+        jobs[n].out = out[n];
+        jobs[n].w = 2;
+        jobs[n].s = 2;
+        jobs[n].v = 1;
+        jobs[n].l = 2 * jobs[n].bkey->bsize;
+        jobs[n].size = (size_t)(jobs[n].w * jobs[n].s * jobs[n].l);
+        jobs[n].l_j = l_j[n];
+        jobs[n].l_j_i = l_j_i[n];
+    }
+    jobs[2].l = 0; /* некорректная длина сектора */
+    l_j[3][1] = 3; /* задания 1 и 3 совпадают по ключу, но не по счётчику второго раздела */
+
+    error = ak_bckey_encrypt_dec_batch(jobs, 4);
+    if((error == ak_error_ok) || (error != jobs[2].error)) goto ext;
+    if((jobs[0].error != ak_error_ok) || (jobs[1].error != ak_error_ok) || (jobs[3].error != ak_error_ok)) goto ext;
+    for(size_t x = 0; x < sizeof(out[2]); ++x) if(out[2][x] != 0) goto ext;
+
+    for(size_t n = 0; n < 4; ++n) {
+        if(n == 2) continue;
+        if(ak_bckey_decrypt_dec(jobs[n].bkey, out[n], dec, jobs[n].size, jobs[n].w, jobs[n].s, jobs[n].v,
+                                jobs[n].l, l_j[n], l_j_i[n]) != ak_error_ok) goto ext;
+        if(memcmp(in[n], dec, jobs[n].size) != 0) goto ext;
+    }
+    result = ak_true;
 
-        case 16:
-            if ((*l_j_ptr_16) + 1 == 0) {
-                ak_error_message( error, __func__, "Further utilization of secret key Kin is impossible" );
-                goto ext;
-            }
-            z0.q[0] = 0;
-            z0.q[1] = 0;
-            P.q[1] = *l_j_ptr_16;
-            P.q[0] = j;
+ext:
+    ak_bckey_destroy(&kuznechik);
+    ak_bckey_destroy(&magma);
+    return result;
+}
 
-            ak_kdf_state_create(&ks, bkey->key.key, bkey->key.key_size, xor_cmac_kuznechik_kdf, (ak_uint8 *)&P,
-                                sizeof(ak_uint128), seed, sizeof(seed), (ak_uint8 *)&z0, sizeof(ak_uint128), 32768);
-            ak_kdf_state_next(&ks, k_j, sizeof(k_j));
-            for(ak_uint64 i = 0; i < s; ++i) {
-                z0.q[1] = j;
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция формирует в name имя сегмента разделяемой памяти для проверок, дополняя prefix
+    идентификатором процесса: одновременно выполняемые проверки в разных процессах не должны
+    подключаться к одному сегменту.                                                                */
+/* ----------------------------------------------------------------------------------------------- */
+static void ak_libakrypt_test_dec_shm_name(char *name, size_t size, const char *prefix) {
+    size_t len = strlen(prefix);
+ #ifdef AK_DEC_SHARED_MEMORY
+    char digits[24];
+    size_t count = 0;
+    unsigned long int pid = (unsigned long int)getpid();
+
+    do {
+        digits[count++] = (char)('0' + pid % 10);
+        pid /= 10;
+    } while(pid != 0);
+    if(len + count + 2 > size) count = 0;
+ #endif
+    if(len + 1 > size) len = size - 1;
+
+    memcpy(name, prefix, len);
+ #ifdef AK_DEC_SHARED_MEMORY
+    if(count != 0) name[len++] = '-';
+    while(count != 0) name[len++] = digits[--count];
+ #endif
+    name[len] = 0;
+}
 
-                P.q[1] = (*l_j_i_ptr_16) / v;
-                P.q[0] = i;
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция проверяет работу кэша производных ключей: после зашифрования ключи разделов и секторов
+    находятся в кэше, расшифрование использует именно их (искажение ключей в кэше приводит
+    к неверному результату), а после уничтожения кэша ключи вновь вырабатываются.
+    Если разделяемая память не поддерживается, проверка не выполняется.                         */
+/* ----------------------------------------------------------------------------------------------- */
+static bool_t ak_libakrypt_test_dec_key_cache(ak_bckey key) {
+    ak_uint64 w = 2, s = 2, v = 1, l = 2 * key->bsize;
+    ak_uint8 in[128], out[128], dec[128];
+    ak_uint64 l_j[2] = {0}, l_j_i[4] = {0};
+    struct dec_key_cache cache;
+    char name[64];
+    ak_uint64 used = 0;
+    bool_t result = ak_false;
+    int error = ak_error_ok;
 
-                ak_kdf_state_create(&ks, k_j, sizeof(k_j), xor_cmac_kuznechik_kdf, (ak_uint8 *)&P, sizeof(ak_uint128),
-                                    seed, sizeof(seed), (ak_uint8 *)&z0, sizeof(ak_uint128), 32768);
-                ak_kdf_state_next(&ks, k_j_i, sizeof(k_j_i));
+    memset(&cache, 0, sizeof(cache));
+    ak_libakrypt_test_dec_shm_name(name, sizeof(name), "/libakrypt-dec-test");
+    if((error = ak_dec_key_cache_open(&cache, name, 64, key)) != ak_error_ok) {
+        return (error == ak_error_undefined_function);
+    }
+    for(size_t x = 0; x < sizeof(in); ++x) in[x] = (ak_uint8)(x * 11 + 1);
 
-                z0.q[0] = 0;
-                z0.q[1] = 0;
+    if(ak_bckey_encrypt_dec(key, in, out, w * s * l, w, s, v, l, l_j, l_j_i) != ak_error_ok) goto ext;
+    for(ak_uint64 n = 0; n < cache.header->count; ++n) used += cache.entries[n].used;
+    if(used == 0) goto ext;
 
-                P.q[1] = (*l_j_ptr_16) + 1;
-                P.q[0] = j;
+    if(ak_bckey_decrypt_dec(key, out, dec, w * s * l, w, s, v, l, l_j, l_j_i) != ak_error_ok) goto ext;
+    if(memcmp(in, dec, (size_t)(w * s * l)) != 0) goto ext;
 
-                ak_kdf_state_create(&ks, bkey->key.key, bkey->key.key_size, xor_cmac_kuznechik_kdf, (ak_uint8 *)&P,
-                                    sizeof(ak_uint128), seed, sizeof(seed), (ak_uint8 *)&z0, sizeof(ak_uint128), 32768);
-                ak_kdf_state_next(&ks, k_j_sh, sizeof(k_j_sh));
+    /* искажаем ключи в кэше: расшифрование должно их использовать */
+    for(ak_uint64 n = 0; n < cache.header->count; ++n) cache.entries[n].key[0] ^= 1;
+    if(ak_bckey_decrypt_dec(key, out, dec, w * s * l, w, s, v, l, l_j, l_j_i) != ak_error_ok) goto ext;
+    if(memcmp(in, dec, (size_t)(w * s * l)) == 0) goto ext;
+    for(ak_uint64 n = 0; n < cache.header->count; ++n) cache.entries[n].key[0] ^= 1;
+    result = ak_true;
 
-                l_j_i_old_16 = *l_j_i_ptr_16;
-                *l_j_i_ptr_16 = 0;
+ext:
+    if(ak_dec_key_cache_destroy(&cache) != ak_error_ok) return ak_false;
+    if(!result) return ak_false;
 
-                z0.q[0] = 0;
-                z0.q[1] = j;
+    if(ak_bckey_decrypt_dec(key, out, dec, w * s * l, w, s, v, l, l_j, l_j_i) != ak_error_ok) return ak_false;
+    return (memcmp(in, dec, (size_t)(w * s * l)) == 0);
+}
 
-                P.q[1] = (*l_j_i_ptr_16) / v;
-                P.q[0] = i;
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция сравнивает компактное представление счётчиков с плоским массивом ref.                */
+/* ----------------------------------------------------------------------------------------------- */
+static bool_t ak_libakrypt_test_dec_counters_equal(ak_dec_counters ctrs, ak_uint64 *ref) {
+    for(ak_uint64 idx = 0; idx < ctrs->count; ++idx) {
+        if(ak_dec_counters_value(ctrs, idx) != ref[idx]) return ak_false;
+    }
+    return ak_true;
+}
 
-                ak_kdf_state_create(&ks, k_j_sh, sizeof(k_j_sh), xor_cmac_kuznechik_kdf, (ak_uint8 *)&P,
-                                    sizeof(ak_uint128), seed, sizeof(seed), (ak_uint8 *)&z0, sizeof(ak_uint128), 32768);
-                ak_kdf_state_next(&ks, k_j_i_sh, sizeof(k_j_i_sh));
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция проверяет компактное представление счётчиков, сравнивая его с плоским массивом:
+    сдвиг базового значения блока, выбор длины приращений по разбросу счётчиков (в том числе
+    её уменьшение при присваивании, когда отстающие счётчики догоняют остальные), возврат блока
+    к наименьшей длине приращений, а также выгрузку и загрузку значений.                         */
+/* ----------------------------------------------------------------------------------------------- */
+static bool_t ak_libakrypt_test_dec_counters(size_t bsize) {
+    struct dec_counters ctrs, copy;
+    ak_uint64 ref[200], flat[200], b = ak_dec_counters_block_size, x = 1;
+    bool_t result = ak_false;
+
+    memset(ref, 0, sizeof(ref));
+    if(ak_dec_counters_create(&ctrs, bsize, 2, 100) != ak_error_ok) return ak_false;
+    if(ak_dec_counters_create(&copy, bsize, 2, 100) != ak_error_ok) {
+        ak_dec_counters_destroy(&ctrs);
+        return ak_false;
+    }
 
-                for(ak_uint64 t = 0; t < q; ++t) {
-                    CTR.q[1] = i;
-                    CTR.q[0] = CTR.q[0] + (l_j_i_old_16 * q + t);
-
-                    if((error = ak_bckey_create_kuznechik(&internalContext)) != ak_error_ok ) {
-                        ak_error_message( error, __func__, "incorrect creation of kuznechik secret key" );
-                        goto ext;
-                    }
-                    ak_bckey_set_key(&internalContext, k_j_i, sizeof(k_j_i));
-                    internalContext.encrypt(&internalContext.key, (ak_uint8 *)&CTR, delta);
-                    ak_bckey_destroy(&internalContext);
-
-                    CTR_sh.q[1] = i;
-                    CTR_sh.q[0] = CTR_sh.q[0] + ((*l_j_i_ptr_16) * q + t);
-
-                    if((error = ak_bckey_create_kuznechik(&internalContext)) != ak_error_ok ) {
-                        ak_error_message( error, __func__, "incorrect creation of kuznechik secret key" );
-                        goto ext;
-                    }
-                    ak_bckey_set_key(&internalContext, k_j_i_sh, sizeof(k_j_i_sh));
-                    internalContext.encrypt(&internalContext.key, (ak_uint8 *)&CTR_sh, delta_sh);
-                    ak_bckey_destroy(&internalContext);
-
-                    *outptr = *inptr ^ delta_sh[0] ^ delta[0];
-                    inptr++;
-                    outptr++;
-                    *outptr = *inptr ^ delta_sh[1] ^ delta[1];
-                    inptr++;
-                    outptr++;
-                }
-                l_j_i_ptr_16++;
-            }
+    /* сдвиг базового значения: все счётчики блока 1 растут вместе, приращения не хранятся */
+    for(ak_uint64 k = 0; k < b; ++k) ak_dec_counters_assign(&ctrs, b + k, ref[b + k] = 200);
+    if(ctrs.block[1].width != 0) goto ext;
+    for(ak_uint64 k = 0; k < b; ++k) ak_dec_counters_assign(&ctrs, b + k, ref[b + k] = 400);
+    if((ctrs.block[1].width != 0) || (ctrs.block[1].base != 400)) goto ext;
+    ak_dec_counters_assign(&ctrs, b + 3, ref[b + 3] = 401);
+    if((ctrs.block[1].width != 1) || (ctrs.block[1].base != 400)) goto ext;
+
+    /* двухбайтовые приращения: разброс счётчиков блока 2 превышает 255 */
+    ak_dec_counters_assign(&ctrs, 2 * b + 5, ref[2 * b + 5] = 1000);
+    if(ctrs.block[2].width != 2) goto ext;
+
+    /* уменьшение при присваивании: остальные счётчики блока 2 догоняют счётчик 5 */
+    for(ak_uint64 k = 0; k < b; ++k) {
+        if(k != 5) ak_dec_counters_assign(&ctrs, 2 * b + k, ref[2 * b + k] = 800);
+    }
+    if((ctrs.block[2].width != 1) || (ctrs.block[2].base != 800)) goto ext;
+
+    /* полные значения имеют длину счётчика алгоритма */
+    ak_dec_counters_assign(&ctrs, 2 * b + 6, ref[2 * b + 6] = ak_dec_counter_max(bsize));
+    if(ctrs.block[2].width != bsize / 2) goto ext;
+    ak_dec_counters_assign(&ctrs, 2 * b + 6, ref[2 * b + 6] = 800);
+
+    /* случайные изменения счётчиков, в том числе неполного последнего блока */
+    for(size_t n = 0; n < 4096; ++n) {
+        x = x * 6364136223846793005LL + 1442695040888963407LL;
+        ak_uint64 idx = (x >> 33) % 200;
+        ak_uint64 value = (idx / b == 3) ? ref[idx] + ((x >> 20) & 0x3ff) : ref[idx] + ((x >> 20) & 1);
+        if(ak_dec_counters_assign(&ctrs, idx, ref[idx] = value) != ak_error_ok) goto ext;
+    }
+    if(!ak_libakrypt_test_dec_counters_equal(&ctrs, ref)) goto ext;
 
-            (*l_j_ptr_16)++;
-            break;
+    /* выгрузка и загрузка сохраняют значения */
+    if(ak_dec_counters_export(&ctrs, flat) != ak_error_ok) goto ext;
+    for(ak_uint64 idx = 0; idx < 200; ++idx) {
+        if(ak_dec_counter_get(bsize, flat, idx) != ref[idx]) goto ext;
     }
+    if(ak_dec_counters_import(&copy, flat) != ak_error_ok) goto ext;
+    if(!ak_libakrypt_test_dec_counters_equal(&copy, ref)) goto ext;
+
+    /* возврат к компактному виду: счётчики блока 2 сближаются */
+    ak_dec_counters_assign(&copy, 2 * b + 7, ref[2 * b + 7] = 70000);
+    if(copy.block[2].width != 4) goto ext;
+    for(ak_uint64 k = 0; k < b; ++k) ak_dec_counters_assign(&copy, 2 * b + k, ref[2 * b + k] = 5000 + k);
+    ak_dec_counters_shrink_block(&copy, 2);
+    if((copy.block[2].width != 1) || (copy.block[2].base != 5000)) goto ext;
+    if(!ak_libakrypt_test_dec_counters_equal(&copy, ref)) goto ext;
+    if(ak_dec_counters_get_memory_size(&copy) >= bsize / 2 * 200) goto ext;
+    result = ak_true;
 
 ext:
-    return error;
+    ak_dec_counters_destroy(&copy);
+    ak_dec_counters_destroy(&ctrs);
+    return result;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция сравнивает многопоточное зашифрование нескольких разделов с последовательным:
+    шифртексты и значения счётчиков разделов и секторов должны совпадать, а многопоточное
+    расшифрование -- восстанавливать исходные данные.                                            */
+/* ----------------------------------------------------------------------------------------------- */
+static bool_t ak_libakrypt_test_dec_parallel(ak_bckey key) {
+    ak_uint64 w = 8, s = 4, v = 2, l = 2 * key->bsize, size = w * s * l;
+    ak_uint8 in[1024], serial[1024], parallel[1024];
+    ak_uint64 l_j[8], l_j_i[32], l_j_p[8], l_j_i_p[32];
+
+    for(size_t x = 0; x < sizeof(in); ++x) in[x] = (ak_uint8)(x * 5 + 9);
+    for(size_t x = 0; x < 8; ++x) ak_dec_counter_set(key->bsize, l_j, x, x % 3);
+    for(size_t x = 0; x < 32; ++x) ak_dec_counter_set(key->bsize, l_j_i, x, x % 5);
+    memcpy(l_j_p, l_j, sizeof(l_j));
+    memcpy(l_j_i_p, l_j_i, sizeof(l_j_i));
+
+    if(ak_bckey_encrypt_dec(key, in, serial, size, w, s, v, l, l_j, l_j_i) != ak_error_ok) return ak_false;
+    if(ak_bckey_encrypt_dec_parallel(key, in, parallel, size, w, s, v, l, l_j_p, l_j_i_p, 3) != ak_error_ok) {
+        return ak_false;
+    }
+    if((memcmp(serial, parallel, (size_t)size) != 0) || (memcmp(l_j, l_j_p, sizeof(l_j)) != 0) ||
+       (memcmp(l_j_i, l_j_i_p, sizeof(l_j_i)) != 0)) return ak_false;
+
+    if(ak_bckey_decrypt_dec_parallel(key, parallel, parallel, size, w, s, v, l, l_j_p, l_j_i_p, 3) != ak_error_ok) {
+        return ak_false;
+    }
+    return (memcmp(in, parallel, (size_t)size) == 0);
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция проверяет зашифрование изменённых секторов: шифртекст и счётчики меняются только
+    у секторов, отмеченных в битовой шкале, а расшифрование всех данных даёт новый открытый текст. */
+/* ----------------------------------------------------------------------------------------------- */
+static bool_t ak_libakrypt_test_dec_dirty(ak_bckey key) {
+    ak_uint64 w = 2, s = 4, v = 1, l = 2 * key->bsize, size = w * s * l;
+    ak_uint8 old[256], in[256], out[256], prev[256], dec[256], dirty[1];
+    ak_uint64 l_j[2] = {0}, l_j_i[8] = {0}, l_j_i_prev[8];
+
+    for(size_t x = 0; x < sizeof(old); ++x) old[x] = (ak_uint8)(x * 17 + 2);
+    if(ak_bckey_encrypt_dec(key, old, out, size, w, s, v, l, l_j, l_j_i) != ak_error_ok) return ak_false;
+
+    /* изменяем сектор 1 раздела 0 и сектор 2 раздела 1 */
+    memcpy(in, old, sizeof(in));
+    in[1 * l + 3] ^= 0x5a;
+    in[(1 * s + 2) * l] ^= 0xa5;
+    if(ak_dec_dirty_bitmap_compare(old, in, w, s, l, dirty) != 2) return ak_false;
+    if(dirty[0] != ((1 << 1) | (1 << (s + 2)))) return ak_false;
+
+    memcpy(prev, out, sizeof(prev));
+    memcpy(l_j_i_prev, l_j_i, sizeof(l_j_i));
+    if(ak_bckey_encrypt_dec_dirty(key, in, out, size, w, s, v, l, l_j, l_j_i, dirty) != ak_error_ok) return ak_false;
+
+    for(ak_uint64 idx = 0; idx < w * s; ++idx) {
+        bool_t flagged = ak_dec_dirty_bit(dirty, idx);
+        bool_t same = (memcmp(prev + idx * l, out + idx * l, (size_t)l) == 0);
+        ak_uint64 c = ak_dec_counter_get(key->bsize, l_j_i, idx);
+        ak_uint64 c_prev = ak_dec_counter_get(key->bsize, l_j_i_prev, idx);
+
+        if(flagged == same) return ak_false;
+        if(c != c_prev + (flagged ? 1 : 0)) return ak_false;
+    }
+
+    if(ak_bckey_decrypt_dec(key, out, dec, size, w, s, v, l, l_j, l_j_i) != ak_error_ok) return ak_false;
+    return (memcmp(in, dec, (size_t)size) == 0);
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция оповещения, сохраняющая наибольшее число перешифрованных разделов.                    */
+/* ----------------------------------------------------------------------------------------------- */
+static void ak_libakrypt_test_dec_progress(ak_uint64 done, ak_uint64 total, ak_pointer arg) {
+    ak_uint64 *calls = (ak_uint64 *)arg;
+
+    calls[0]++;
+    if(done > calls[1]) calls[1] = done;
+    calls[2] = total;
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция проверяет многопоточное перешифрование всех разделов с ограничением скорости:
+    счётчики разделов увеличиваются, счётчики секторов обнуляются, о каждом разделе сообщается
+    функции оповещения, а расшифрование на новых ключах даёт исходные данные.                    */
+/* ----------------------------------------------------------------------------------------------- */
+static bool_t ak_libakrypt_test_dec_re_encrypt_volumes(ak_bckey key) {
+    ak_uint64 w = 4, s = 2, v = 1, l = 2 * key->bsize, size = w * s * l;
+    ak_uint8 in[512], out[512], prev[512], dec[512];
+    ak_uint64 l_j[4] = {0}, l_j_i[8] = {0}, calls[3] = {0, 0, 0};
+
+    for(size_t x = 0; x < sizeof(in); ++x) in[x] = (ak_uint8)(x * 29 + 7);
+    if(ak_bckey_encrypt_dec(key, in, out, size, w, s, v, l, l_j, l_j_i) != ak_error_ok) return ak_false;
+    memcpy(prev, out, sizeof(prev));
+
+    if(ak_bckey_re_encrypt_dec_volumes(key, out, out, size, w, s, v, l, l_j, l_j_i, 2, 1 << 20,
+                                       ak_libakrypt_test_dec_progress, calls) != ak_error_ok) return ak_false;
+    if((calls[0] != w) || (calls[1] != w) || (calls[2] != w)) return ak_false;
+    for(ak_uint64 j = 0; j < w; ++j) {
+        if(ak_dec_counter_get(key->bsize, l_j, j) != 1) return ak_false;
+        if(memcmp(prev + j * s * l, out + j * s * l, (size_t)(s * l)) == 0) return ak_false;
+    }
+    for(ak_uint64 idx = 0; idx < w * s; ++idx) {
+        if(ak_dec_counter_get(key->bsize, l_j_i, idx) != 0) return ak_false;
+    }
+
+    if(ak_bckey_decrypt_dec(key, out, dec, size, w, s, v, l, l_j, l_j_i) != ak_error_ok) return ak_false;
+    return (memcmp(in, dec, (size_t)size) == 0);
+}
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция повторяет проверки зашифрования и перешифрования при исчерпании счётчика с рабочими
+    областями, размещаемыми в защищённой области памяти потока; после проверок вся память
+    области должна быть возвращена. Область недостаточного размера должна отвергаться,
+    а области потоков многопоточных вызовов -- использоваться повторно: после нескольких вызовов
+    в списке свободных областей остаётся не больше областей, чем потоков одного вызова.
+    Если создать или заблокировать область в памяти не удалось, проверки не выполняются.          */
+/* ----------------------------------------------------------------------------------------------- */
+static bool_t ak_libakrypt_test_dec_arena(ak_bckey key) {
+    ak_dec_arena arena = NULL;
+    bool_t result = ak_false;
+    int error = ak_error_ok;
+ #ifdef LIBAKRYPT_HAVE_PTHREAD_H
+    size_t stock = 0;
+ #endif
+
+    if(ak_dec_set_secure_arena(1) != ak_error_wrong_length) return ak_false;
+    if(ak_dec_thread_arena() != NULL) return ak_false;
+    if((error = ak_dec_set_secure_arena(65536)) != ak_error_ok) return (error == ak_error_out_of_memory);
+
+    result = ak_libakrypt_test_dec_reference(key) && ak_libakrypt_test_dec_exhaustion(key);
+    if(((arena = ak_dec_thread_arena()) == NULL) || (arena->used != 0)) result = ak_false;
+
+ #ifdef LIBAKRYPT_HAVE_PTHREAD_H
+    /* каждая проверка выполняет два вызова, создающих по три потока */
+    if(!ak_libakrypt_test_dec_parallel(key) || !ak_libakrypt_test_dec_parallel(key)) result = ak_false;
+    pthread_mutex_lock(&ak_dec_arena_stock_mutex);
+    for(ak_dec_arena_slot slot = ak_dec_arena_stock; slot != NULL; slot = slot->next) {
+        if(slot->arena.used != 0) result = ak_false;
+        stock++;
+    }
+    pthread_mutex_unlock(&ak_dec_arena_stock_mutex);
+  #ifdef AK_DEC_THREADS
+    if((stock == 0) || (stock > 3)) result = ak_false;
+  #endif
+ #endif
+    ak_dec_set_secure_arena(0);
+
+    return result;
 }
 
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция проверяет подбор геометрии на небольшом объёме данных: рекомендуемая геометрия должна
+    входить в список измеренных, все геометрии должны охватывать данные целиком, объём данных,
+    который нельзя охватить целиком, должен отвергаться, а подключённый к ключу кэш производных
+    ключей не должен использоваться при измерениях и должен оставаться подключённым после них.    */
+/* ----------------------------------------------------------------------------------------------- */
+static bool_t ak_libakrypt_test_dec_tune(ak_bckey key) {
+    struct dec_geometry list[ak_dec_tune_max_geometries], best;
+    struct dec_key_cache cache;
+    size_t count = ak_dec_tune_max_geometries, size = 4096;
+    bool_t attached = ak_false, result = ak_false;
+    ak_uint64 used = 0;
+    int error = ak_error_ok;
+    char name[64];
+
+    memset(&cache, 0, sizeof(cache));
+    ak_libakrypt_test_dec_shm_name(name, sizeof(name), "/libakrypt-dec-tune-test");
+    attached = (ak_dec_key_cache_open(&cache, name, 64, key) == ak_error_ok);
+
+    if((error = ak_dec_tune(key, size, 1, dec_sequential_profile, size, list, &count, &best)) != ak_error_ok) {
+        result = (error == ak_error_undefined_function);
+        goto ext;
+    }
+    if((count == 0) || (count > ak_dec_tune_max_geometries)) goto ext;
+    if((best.s * best.l != size) || (best.v == 0) || (best.throughput <= 0)) goto ext;
+    for(size_t k = 0; k < count; ++k) {
+        if(list[k].s * list[k].l != size) goto ext;
+        if((list[k].l == best.l) && (list[k].s == best.s) && (list[k].v == best.v)) result = ak_true;
+    }
+    /* для алгоритма Магма один раздел не может охватить 1 Мб ни при какой длине сектора */
+    if(ak_dec_tune(key, 1048576, 1, dec_sequential_profile, size, NULL, NULL, &best) != ak_error_wrong_length) {
+        result = ak_false;
+    }
+    if(attached) {
+        for(ak_uint64 n = 0; n < cache.header->count; ++n) used += cache.entries[n].used;
+        if((used != 0) || (ak_dec_key_cache_find(key) != &cache)) result = ak_false;
+    }
+
+ext:
+    if(attached && (ak_dec_key_cache_destroy(&cache) != ak_error_ok)) return ak_false;
+    return result;
+}
 
 bool_t ak_libakrypt_test_dec() {
     struct bckey key;
@@ -767,6 +3813,9 @@ bool_t ak_libakrypt_test_dec() {
     ak_uint64 l_j2[1];
     ak_uint64 l_j_i2[2];
 
+    struct dec_job job;
+    struct dec_counters ctrs;
+
     memset(l_j, 0, sizeof(l_j));
     memset(l_j_i, 0, sizeof(l_j_i));
 
@@ -789,6 +3838,47 @@ bool_t ak_libakrypt_test_dec() {
         goto ex1;
     }
 
+    if(!ak_libakrypt_test_dec_reference(&key)) {
+        ak_error_message(error = ak_error_not_equal_data, __func__,
+                         "incorrect comparison with reference dec encryption with magma cipher");
+        goto ex1;
+    }
+
+    if(!ak_libakrypt_test_dec_exhaustion(&key)) {
+        ak_error_message(error = ak_error_not_equal_data, __func__,
+                         "incorrect in-place dec encryption with exhausted sector counter");
+        goto ex1;
+    }
+
+    if(!ak_libakrypt_test_dec_arena(&key)) {
+        ak_error_message(error = ak_error_not_equal_data, __func__,
+                         "incorrect dec encryption with secure arena");
+        goto ex1;
+    }
+
+    if(!ak_libakrypt_test_dec_key_cache(&key)) {
+        ak_error_message(error = ak_error_not_equal_data, __func__,
+                         "incorrect dec encryption with shared key cache and magma cipher");
+        goto ex1;
+    }
+
+    if(!ak_libakrypt_test_dec_parallel(&key)) {
+        ak_error_message(error = ak_error_not_equal_data, __func__,
+                         "incorrect comparison of parallel and serial dec encryption with magma cipher");
+        goto ex1;
+    }
+
+    if(!ak_libakrypt_test_dec_dirty(&key)) {
+        ak_error_message(error = ak_error_not_equal_data, __func__,
+                         "incorrect dec encryption of dirty sectors with magma cipher");
+        goto ex1;
+    }
+
+    if(!ak_libakrypt_test_dec_tune(&key)) {
+        ak_error_message(error = ak_error_not_equal_data, __func__, "incorrect tuning of dec geometry");
+        goto ex1;
+    }
+
     if(audit >= ak_log_maximum) {
         ak_error_message(ak_error_ok, __func__, "dec test for magma is Ok");
     }
@@ -818,10 +3908,87 @@ ex1:
         goto ex2;
     }
 
+    if(!ak_libakrypt_test_dec_reference(&key)) {
+        ak_error_message(error = ak_error_not_equal_data, __func__,
+                         "incorrect comparison with reference dec encryption with kuznechik cipher");
+        goto ex2;
+    }
+
+    if(!ak_libakrypt_test_dec_kuznechik(skey)) {
+        ak_error_message(error = ak_error_not_equal_data, __func__,
+                         "incorrect kuznechik keystream generation for dec sectors");
+        goto ex2;
+    }
+
     if(audit >= ak_log_maximum) {
         ak_error_message(ak_error_ok, __func__, "dec test for kuznechik is Ok");
     }
 
+    memset(l_j2, 0, sizeof(l_j2));
+    memset(l_j_i2, 0, sizeof(l_j_i2));
+    memset(&job, 0, sizeof(job));
+    job.bkey = &key; job.in = in2; job.out = out2; job.size = 64;
+    job.w = 1; job.s = 2; job.v = 3; job.l = 32;
+    job.l_j = l_j2; job.l_j_i = l_j_i2;
+
+    ak_bckey_encrypt_dec_batch(&job, 1);
+    ak_bckey_decrypt_dec(&key, out2, out2_dec, 64, 1, 2, 3, 32, l_j2, l_j_i2);
+
+    if((job.error != ak_error_ok) || (memcmp(in2, out2_dec, sizeof(out2_dec)) != 0)) {
+        ak_error_message(error = ak_error_not_equal_data, __func__,
+                         "incorrect data comparison after dec batch encryption with kuznechik cipher");
+        goto ex2;
+    }
+
+    if(!ak_libakrypt_test_dec_batch(skey, sizeof(skey))) {
+        ak_error_message(error = ak_error_not_equal_data, __func__,
+                         "incorrect processing of mixed dec batch with invalid job");
+        goto ex2;
+    }
+
+    if(!ak_libakrypt_test_dec_key_cache(&key)) {
+        ak_error_message(error = ak_error_not_equal_data, __func__,
+                         "incorrect dec encryption with shared key cache");
+        goto ex2;
+    }
+
+    if(!ak_libakrypt_test_dec_parallel(&key)) {
+        ak_error_message(error = ak_error_not_equal_data, __func__,
+                         "incorrect comparison of parallel and serial dec encryption");
+        goto ex2;
+    }
+
+    if(!ak_libakrypt_test_dec_dirty(&key)) {
+        ak_error_message(error = ak_error_not_equal_data, __func__,
+                         "incorrect dec encryption of dirty sectors");
+        goto ex2;
+    }
+
+    if(!ak_libakrypt_test_dec_re_encrypt_volumes(&key)) {
+        ak_error_message(error = ak_error_not_equal_data, __func__,
+                         "incorrect decryption after re-encryption of all dec volumes");
+        goto ex2;
+    }
+
+    memset(l_j2, 0, sizeof(l_j2));
+    if((error = ak_dec_counters_create(&ctrs, key.bsize, 1, 2)) != ak_error_ok) goto ex2;
+    ak_bckey_encrypt_dec_counters(&key, in2, out2, 64, 1, 2, 3, 32, l_j2, &ctrs);
+    ak_dec_counters_export(&ctrs, l_j_i2);
+    ak_dec_counters_destroy(&ctrs);
+    ak_bckey_decrypt_dec(&key, out2, out2_dec, 64, 1, 2, 3, 32, l_j2, l_j_i2);
+
+    if(memcmp(in2, out2_dec, sizeof(out2_dec)) != 0) {
+        ak_error_message(error = ak_error_not_equal_data, __func__,
+                         "incorrect data comparison after dec encryption with compact counters");
+        goto ex2;
+    }
+
+    if(!ak_libakrypt_test_dec_counters(8) || !ak_libakrypt_test_dec_counters(16)) {
+        ak_error_message(error = ak_error_not_equal_data, __func__,
+                         "incorrect values of compact dec counters");
+        goto ex2;
+    }
+
     if((error = ak_bckey_create_magma(&key)) != ak_error_ok) {
         ak_error_message(error, __func__, "incorrect creation of magma secret key");
         return ak_false;
@@ -0,0 +1,227 @@
+/* ----------------------------------------------------------------------------------------------- */
+/*! \file dec.h
+    \brief Описание типов и функций режима шифрования `DEC` (шифрование дисковых разделов).
+
+    Файл содержит объявления, предназначенные для включения в заголовочный файл libakrypt.h
+    при переносе режима в библиотеку; до переноса его следует подключать вместо libakrypt.h.    */
+/* ----------------------------------------------------------------------------------------------- */
+
+#ifndef __DEC_H__
+#define __DEC_H__
+
+#include <libakrypt.h>
+
+#ifndef dll_export
+ #define dll_export
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct dec_key_cache_header;
+struct dec_key_cache_entry;
+struct dec_counters_block;
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Задание на зашифрование (расшифрование) данных в режиме `DEC`, обрабатываемое функциями
+    \ref ak_bckey_encrypt_dec_batch() и \ref ak_bckey_decrypt_dec_batch().
+    Назначение полей совпадает с назначением параметров функции \ref ak_bckey_encrypt_dec().     */
+/* ----------------------------------------------------------------------------------------------- */
+typedef struct dec_job {
+    /*! Контекст ключа алгоритма блочного шифрования */
+    ak_bckey bkey;
+    /*! Указатель на входные данные */
+    ak_pointer in;
+    /*! Указатель на выходные данные */
+    ak_pointer out;
+    /*! Размер данных (в байтах) */
+    size_t size;
+    /*! Количество разделов */
+    ak_uint64 w;
+    /*! Количество секторов в разделе */
+    ak_uint64 s;
+    /*! Частота смены ключа */
+    ak_uint64 v;
+    /*! Длина сектора в байтах */
+    ak_uint64 l;
+    /*! Указатель на счётчики для разделов */
+    ak_pointer l_j;
+    /*! Указатель на счётчики для секторов */
+    ak_pointer l_j_i;
+    /*! Код ошибки, возникшей при обработке задания */
+    int error;
+} *ak_dec_job;
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Контекст кэша производных ключей режима `DEC`, размещаемого в разделяемой памяти
+    и подключаемого функцией \ref ak_dec_key_cache_open().                                     */
+/* ----------------------------------------------------------------------------------------------- */
+typedef struct dec_key_cache {
+    /*! Контекст ключа, с которым связан кэш */
+    ak_bckey bkey;
+    /*! Заголовок сегмента разделяемой памяти */
+    struct dec_key_cache_header *header;
+    /*! Записи кэша */
+    struct dec_key_cache_entry *entries;
+    /*! Размер сегмента в байтах */
+    size_t size;
+    /*! Имя сегмента */
+    char name[256];
+    /*! Следующий кэш в списке кэшей, подключённых в процессе */
+    struct dec_key_cache *next;
+} *ak_dec_key_cache;
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Компактное представление счётчиков секторов l_j_i, создаваемое функцией
+    \ref ak_dec_counters_create() и используемое функциями \ref ak_bckey_encrypt_dec_counters()
+    и \ref ak_bckey_decrypt_dec_counters() вместо плоского массива счётчиков.                  */
+/* ----------------------------------------------------------------------------------------------- */
+typedef struct dec_counters {
+    /*! Длина блока алгоритма блочного шифрования */
+    size_t bsize;
+    /*! Количество разделов */
+    ak_uint64 w;
+    /*! Количество секторов в разделе */
+    ak_uint64 s;
+    /*! Общее количество счётчиков (w*s) */
+    ak_uint64 count;
+    /*! Количество блоков */
+    ak_uint64 blocks;
+    /*! Массив блоков */
+    struct dec_counters_block *block;
+} *ak_dec_counters;
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Защищённая область памяти для ключевой информации и временных буферов режима `DEC`,
+    создаваемая функцией \ref ak_dec_arena_create().                                               */
+/* ----------------------------------------------------------------------------------------------- */
+typedef struct dec_arena {
+    /*! Указатель на начало области */
+    ak_uint8 *base;
+    /*! Размер области в байтах */
+    size_t size;
+    /*! Количество занятых байт */
+    size_t used;
+    /*! Признак размещения области в больших страницах */
+    bool_t huge;
+} *ak_dec_arena;
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Функция, вызываемая функцией \ref ak_bckey_re_encrypt_dec_volumes() после перешифрования
+    очередного раздела; done -- количество перешифрованных разделов, total -- их общее количество. */
+/* ----------------------------------------------------------------------------------------------- */
+typedef void (ak_dec_progress_function)(ak_uint64 done, ak_uint64 total, ak_pointer arg);
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Профиль нагрузки, для которого функция \ref ak_bckey_tune_dec() подбирает параметры режима. */
+/* ----------------------------------------------------------------------------------------------- */
+typedef enum {
+    /*! Последовательная запись больших объёмов данных */
+    dec_sequential_profile,
+    /*! Запись отдельных секторов в случайном порядке */
+    dec_random_small_profile,
+    /*! Многократная перезапись небольшого множества секторов */
+    dec_write_heavy_profile
+} dec_profile_t;
+
+/* ----------------------------------------------------------------------------------------------- */
+/*! Параметры режима `DEC` и результаты их измерения функцией \ref ak_bckey_tune_dec().          */
+/* ----------------------------------------------------------------------------------------------- */
+typedef struct dec_geometry {
+    /*! Длина сектора в байтах */
+    ak_uint64 l;
+    /*! Количество секторов в разделе */
+    ak_uint64 s;
+    /*! Частота смены ключа */
+    ak_uint64 v;
+    /*! Производительность зашифрования (байт в секунду) */
+    double throughput;
+    /*! Доля времени зашифрования, затрачиваемая на выработку производных ключей */
+    double kdf_overhead;
+    /*! Объём памяти (в байтах) счётчиков разделов и секторов в виде плоских массивов */
+    size_t flat_counters_size;
+    /*! Объём памяти (в байтах) счётчиков в компактном представлении */
+    size_t compact_counters_size;
+} *ak_dec_geometry;
+
+/* ----------------------------------------------------------------------------------------------- */
+/*                              зашифрование и расшифрование данных                                */
+/* ----------------------------------------------------------------------------------------------- */
+/*! \brief Зашифрование данных в режиме `DEC`. */
+ dll_export int ak_bckey_encrypt_dec( ak_bckey , ak_pointer , ak_pointer , size_t , ak_uint64 ,
+                                     ak_uint64 , ak_uint64 , ak_uint64 , ak_pointer , ak_pointer );
+/*! \brief Расшифрование данных в режиме `DEC`. */
+ dll_export int ak_bckey_decrypt_dec( ak_bckey , ak_pointer , ak_pointer , size_t , ak_uint64 ,
+                                     ak_uint64 , ak_uint64 , ak_uint64 , ak_pointer , ak_pointer );
+/*! \brief Перешифрование раздела j на новом ключе раздела. */
+ dll_export int ak_bckey_re_encrypt_dec( ak_bckey , ak_pointer , ak_pointer , size_t , ak_uint64 ,
+                                     ak_uint64 , ak_uint64 , ak_uint64 , ak_pointer , ak_pointer , ak_uint64 );
+/*! \brief Зашифрование набора независимых массивов данных. */
+ dll_export int ak_bckey_encrypt_dec_batch( ak_dec_job , size_t );
+/*! \brief Расшифрование набора независимых массивов данных. */
+ dll_export int ak_bckey_decrypt_dec_batch( ak_dec_job , size_t );
+/*! \brief Зашифрование данных со счётчиками секторов в компактном представлении. */
+ dll_export int ak_bckey_encrypt_dec_counters( ak_bckey , ak_pointer , ak_pointer , size_t , ak_uint64 ,
+                                     ak_uint64 , ak_uint64 , ak_uint64 , ak_pointer , ak_dec_counters );
+/*! \brief Расшифрование данных со счётчиками секторов в компактном представлении. */
+ dll_export int ak_bckey_decrypt_dec_counters( ak_bckey , ak_pointer , ak_pointer , size_t , ak_uint64 ,
+                                     ak_uint64 , ak_uint64 , ak_uint64 , ak_pointer , ak_dec_counters );
+/*! \brief Многопоточное зашифрование данных. */
+ dll_export int ak_bckey_encrypt_dec_parallel( ak_bckey , ak_pointer , ak_pointer , size_t , ak_uint64 ,
+                                     ak_uint64 , ak_uint64 , ak_uint64 , ak_pointer , ak_pointer , size_t );
+/*! \brief Многопоточное расшифрование данных. */
+ dll_export int ak_bckey_decrypt_dec_parallel( ak_bckey , ak_pointer , ak_pointer , size_t , ak_uint64 ,
+                                     ak_uint64 , ak_uint64 , ak_uint64 , ak_pointer , ak_pointer , size_t );
+/*! \brief Перешифрование всех разделов на новых ключах с ограничением скорости. */
+ dll_export int ak_bckey_re_encrypt_dec_volumes( ak_bckey , ak_pointer , ak_pointer , size_t , ak_uint64 ,
+                                     ak_uint64 , ak_uint64 , ak_uint64 , ak_pointer , ak_pointer , size_t ,
+                                     ak_uint64 , ak_dec_progress_function * , ak_pointer );
+/*! \brief Зашифрование только изменённых секторов. */
+ dll_export int ak_bckey_encrypt_dec_dirty( ak_bckey , ak_pointer , ak_pointer , size_t , ak_uint64 ,
+                                     ak_uint64 , ak_uint64 , ak_uint64 , ak_pointer , ak_pointer ,
+                                     const ak_uint8 * );
+/*! \brief Построение битовой шкалы изменённых секторов. */
+ dll_export ak_uint64 ak_dec_dirty_bitmap_compare( ak_const_pointer , ak_const_pointer , ak_uint64 ,
+                                     ak_uint64 , ak_uint64 , ak_uint8 * );
+/*! \brief Подбор параметров режима для заданного профиля нагрузки. */
+ dll_export int ak_bckey_tune_dec( ak_bckey , size_t , ak_uint64 , dec_profile_t , ak_dec_geometry ,
+                                     size_t * , ak_dec_geometry );
+
+/* ----------------------------------------------------------------------------------------------- */
+/*                            компактное представление счётчиков                                   */
+/* ----------------------------------------------------------------------------------------------- */
+/*! \brief Создание компактного представления счётчиков секторов. */
+ dll_export int ak_dec_counters_create( ak_dec_counters , size_t , ak_uint64 , ak_uint64 );
+/*! \brief Уничтожение компактного представления счётчиков секторов. */
+ dll_export int ak_dec_counters_destroy( ak_dec_counters );
+/*! \brief Загрузка значений счётчиков из плоского массива. */
+ dll_export int ak_dec_counters_import( ak_dec_counters , ak_pointer );
+/*! \brief Выгрузка значений счётчиков в плоский массив. */
+ dll_export int ak_dec_counters_export( ak_dec_counters , ak_pointer );
+/*! \brief Объём памяти, занимаемой компактным представлением. */
+ dll_export size_t ak_dec_counters_get_memory_size( ak_dec_counters );
+
+/* ----------------------------------------------------------------------------------------------- */
+/*                          кэш производных ключей и защищённая память                             */
+/* ----------------------------------------------------------------------------------------------- */
+/*! \brief Подключение кэша производных ключей в разделяемой памяти. */
+ dll_export int ak_dec_key_cache_open( ak_dec_key_cache , const char * , size_t , ak_bckey );
+/*! \brief Отключение кэша производных ключей. */
+ dll_export int ak_dec_key_cache_close( ak_dec_key_cache );
+/*! \brief Затирание и удаление кэша производных ключей. */
+ dll_export int ak_dec_key_cache_destroy( ak_dec_key_cache );
+/*! \brief Создание защищённой области памяти. */
+ dll_export int ak_dec_arena_create( ak_dec_arena , size_t );
+/*! \brief Уничтожение защищённой области памяти. */
+ dll_export int ak_dec_arena_destroy( ak_dec_arena );
+/*! \brief Включение и отключение защищённых областей памяти потоков. */
+ dll_export int ak_dec_set_secure_arena( size_t );
+
+/*! \brief Тестирование режима `DEC`. */
+ dll_export bool_t ak_libakrypt_test_dec( void );
+
+#ifdef __cplusplus
+} /* конец extern "C" */
+#endif
+#endif